@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <raylib.h>
+
+#include "module.h"
+#include "pixel.h"
+
+struct module image_init(void);
+struct module pdf_init(void);
+struct module video_init(void);
+struct module fallback_init(void);
+
+#define N_MODULES 4
+#define OPEN_RUNS 5
+#define FLIP_RUNS 20
+#define SEEK_RUNS 9
+#define DECODE_FRAMES 300
+#define BACK_FRAMES 60
+#define CONVERT_RUNS 10
+// pixel counts up to this are checked one by one, so every tail length of every implementation is hit
+#define CHECK_PIXELS 67
+
+static const char *module_names[N_MODULES] = {"image", "pdf", "video", "fallback"};
+
+// mismatches of the vectorized pixel functions against the scalar ones, any fails the run
+static long failures = 0;
+
+struct samples {
+	double values[DECODE_FRAMES];
+	int n;
+};
+
+static int compare_double(const void *a, const void *b) {
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static void add_sample(struct samples *s, double value) {
+	if (s->n < DECODE_FRAMES) {
+		s->values[s->n++] = value;
+	}
+}
+
+// one json object per line, times in milliseconds
+static void report(const char *file, const char *module, const char *metric, struct samples *s) {
+	if (s->n == 0) {
+		return;
+	}
+
+	qsort(s->values, s->n, sizeof(double), compare_double);
+	double sum = 0;
+	for (int i = 0; i < s->n; i++) {
+		sum += s->values[i];
+	}
+
+	printf("{\"file\":\"%s\",\"module\":\"%s\",\"metric\":\"%s\",\"n\":%d,"
+	       "\"min\":%.3f,\"median\":%.3f,\"mean\":%.3f,\"max\":%.3f}\n",
+	       file, module, metric, s->n, s->values[0], s->values[s->n / 2], sum / s->n, s->values[s->n - 1]);
+}
+
+static void report_value(const char *file, const char *module, const char *metric, double value) {
+	printf("{\"file\":\"%s\",\"module\":\"%s\",\"metric\":\"%s\",\"value\":%.3f}\n", file, module, metric, value);
+}
+
+static void close_media(struct media *media) {
+	if (media->close != NULL) {
+		media->close(media);
+	} else {
+		UnloadTexture(media->texture);
+	}
+}
+
+// opens the file like the viewer does and returns the index of the module that took it
+static int open_media(struct module *modules, struct media *media, const char *file) {
+	*media = (struct media){0};
+	for (int i = 0; i < N_MODULES; i++) {
+		if (modules[i].open(media, file)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// both pixel orders, every short length and a long odd one, from an unaligned source
+static void check_convert(void) {
+	size_t max = 4099;
+	uint8_t *src = malloc(max * 3 + 1);
+	uint8_t *expected = malloc(max * 4);
+	uint8_t *actual = malloc(max * 4);
+	for (size_t i = 0; i < max * 3 + 1; i++) {
+		src[i] = rand();
+	}
+
+	long mismatches = 0;
+	for (int order = PIXEL_RGB; order <= PIXEL_BGR; order++) {
+		for (size_t n = 0; n <= CHECK_PIXELS + 1; n++) {
+			size_t npixels = n <= CHECK_PIXELS ? n : max;
+			pixel_to_rgba_scalar(expected, src + 1, npixels, order);
+			pixel_to_rgba(actual, src + 1, npixels, order);
+			for (size_t i = 0; i < npixels * 4; i++) {
+				mismatches += expected[i] != actual[i];
+			}
+		}
+	}
+
+	report_value("synthetic", pixel_impl_name(), "convert_rgba_mismatched_bytes", mismatches);
+	failures += mismatches;
+	free(src);
+	free(expected);
+	free(actual);
+}
+
+// every gain the compare mode could use, at the same lengths as the conversion
+static void check_absdiff(void) {
+	size_t max = 4099;
+	uint8_t *a = malloc(max * 4 + 1);
+	uint8_t *b = malloc(max * 4);
+	uint8_t *expected = malloc(max * 4);
+	uint8_t *actual = malloc(max * 4);
+	for (size_t i = 0; i < max * 4; i++) {
+		a[i] = rand();
+		// mostly small differences, which the gain amplifies up to saturation
+		b[i] = a[i] + rand() % 16 - 8;
+	}
+	a[max * 4] = rand();
+
+	long mismatches = 0;
+	for (int gain = 0; gain <= 8; gain++) {
+		for (size_t n = 0; n <= CHECK_PIXELS + 1; n++) {
+			size_t npixels = n <= CHECK_PIXELS ? n : max;
+			pixel_absdiff_scalar(expected, a + 1, b, npixels, gain);
+			pixel_absdiff(actual, a + 1, b, npixels, gain);
+			for (size_t i = 0; i < npixels * 4; i++) {
+				mismatches += expected[i] != actual[i];
+			}
+		}
+	}
+
+	report_value("synthetic", pixel_impl_name(), "absdiff_mismatched_bytes", mismatches);
+	failures += mismatches;
+	free(a);
+	free(b);
+	free(expected);
+	free(actual);
+}
+
+// checks the vectorized rgb to rgba conversion against the scalar one on the file's pixels
+static void bench_convert(const char *file) {
+	Image image = LoadImage(file);
+	if (image.data == NULL || image.format != PIXELFORMAT_UNCOMPRESSED_R8G8B8) {
+		UnloadImage(image);
+		return;
+	}
+
+	size_t npixels = (size_t) image.width * image.height;
+	uint8_t *expected = malloc(npixels * 4);
+	uint8_t *actual = malloc(npixels * 4);
+	struct samples scalar = {0};
+	struct samples simd = {0};
+
+	for (int run = 0; run < CONVERT_RUNS; run++) {
+		double start = GetTime();
+		pixel_to_rgba_scalar(expected, image.data, npixels, PIXEL_RGB);
+		add_sample(&scalar, 1000 * (GetTime() - start));
+
+		start = GetTime();
+		pixel_to_rgba(actual, image.data, npixels, PIXEL_RGB);
+		add_sample(&simd, 1000 * (GetTime() - start));
+	}
+
+	long mismatches = 0;
+	for (size_t i = 0; i < npixels * 4; i++) {
+		mismatches += expected[i] != actual[i];
+	}
+
+	report(file, "scalar", "convert_rgba_ms", &scalar);
+	report(file, pixel_impl_name(), "convert_rgba_ms", &simd);
+	report_value(file, pixel_impl_name(), "convert_rgba_mismatched_bytes", mismatches);
+	failures += mismatches;
+
+	// difference of the image and itself moved by a pixel, as the compare mode computes it
+	uint8_t *diff_expected = malloc(npixels * 4);
+	uint8_t *diff_actual = malloc(npixels * 4);
+	scalar = (struct samples){0};
+	simd = (struct samples){0};
+	for (int run = 0; run < CONVERT_RUNS; run++) {
+		double start = GetTime();
+		pixel_absdiff_scalar(diff_expected, expected, expected + 4, npixels - 1, 3);
+		add_sample(&scalar, 1000 * (GetTime() - start));
+
+		start = GetTime();
+		pixel_absdiff(diff_actual, expected, expected + 4, npixels - 1, 3);
+		add_sample(&simd, 1000 * (GetTime() - start));
+	}
+
+	mismatches = 0;
+	for (size_t i = 0; i < (npixels - 1) * 4; i++) {
+		mismatches += diff_expected[i] != diff_actual[i];
+	}
+
+	report(file, "scalar", "absdiff_ms", &scalar);
+	report(file, pixel_impl_name(), "absdiff_ms", &simd);
+	report_value(file, pixel_impl_name(), "absdiff_mismatched_bytes", mismatches);
+	failures += mismatches;
+
+	free(diff_expected);
+	free(diff_actual);
+
+	free(expected);
+	free(actual);
+	UnloadImage(image);
+}
+
+static void bench_file(struct module *modules, const char *file) {
+	struct samples s = {0};
+	struct media media;
+	int mod = -1;
+
+	for (int run = 0; run < OPEN_RUNS; run++) {
+		double start = GetTime();
+		mod = open_media(modules, &media, file);
+		add_sample(&s, 1000 * (GetTime() - start));
+		if (run < OPEN_RUNS - 1) {
+			close_media(&media);
+		}
+	}
+
+	const char *name = mod < 0 ? "none" : module_names[mod];
+	report(file, name, "first_texture_ms", &s);
+
+	if (strcmp(name, "image") == 0) {
+		bench_convert(file);
+	}
+
+	if (strcmp(name, "pdf") == 0) {
+		s = (struct samples){0};
+		for (int i = 0; i < FLIP_RUNS; i++) {
+			double start = GetTime();
+			media.set_index(&media, INDEX_RELATIVE, 1);
+			add_sample(&s, 1000 * (GetTime() - start));
+		}
+		report(file, name, "page_flip_ms", &s);
+	}
+
+	if (strcmp(name, "video") == 0) {
+		s = (struct samples){0};
+		for (int i = 0; i < SEEK_RUNS; i++) {
+			int target = (i * 7 + 3) % 10;
+			double start = GetTime();
+			media.set_index(&media, INDEX_ABSOLUTE, target);
+			add_sample(&s, 1000 * (GetTime() - start));
+		}
+		report(file, name, "seek_ms", &s);
+
+		media.set_index(&media, INDEX_ABSOLUTE, 0);
+		s = (struct samples){0};
+		int frames = 0;
+		double start = GetTime();
+		for (; frames < DECODE_FRAMES; frames++) {
+			double frame_start = GetTime();
+			media.set_index(&media, INDEX_RELATIVE, 1);
+			if (media.texture.id == 0) {
+				break;
+			}
+			add_sample(&s, 1000 * (GetTime() - frame_start));
+		}
+		double elapsed = GetTime() - start;
+		report(file, name, "frame_decode_ms", &s);
+		if (frames > 0 && elapsed > 0) {
+			report_value(file, name, "decode_fps", frames / elapsed);
+		}
+
+		s = (struct samples){0};
+		for (int i = 0; i < BACK_FRAMES && i < frames; i++) {
+			double frame_start = GetTime();
+			media.set_index(&media, INDEX_RELATIVE, -1);
+			if (media.texture.id == 0) {
+				break;
+			}
+			add_sample(&s, 1000 * (GetTime() - frame_start));
+		}
+		report(file, name, "step_back_ms", &s);
+	}
+
+	close_media(&media);
+}
+
+int main(int argc, const char **argv) {
+	if (argc < 2) {
+		printf("Usage: %s [files...]\n", argv[0]);
+		printf("Prints one json object per measurement to stdout, fails if a vectorized pixel\n");
+		printf("function does not match the scalar one.\n");
+		return 1;
+	}
+
+	// textures need a gl context, so a hidden window is created
+	SetTraceLogLevel(LOG_NONE);
+	SetConfigFlags(FLAG_WINDOW_HIDDEN);
+	InitWindow(1280, 720, "imgview2-bench");
+
+	struct module modules[N_MODULES] = {
+		image_init(),
+		pdf_init(),
+		video_init(),
+		fallback_init(),
+	};
+
+	check_convert();
+	check_absdiff();
+	for (int i = 1; i < argc; i++) {
+		bench_file(modules, argv[i]);
+		fflush(stdout);
+	}
+
+	CloseWindow();
+	if (failures > 0) {
+		fprintf(stderr, "%ld bytes differ from the scalar pixel functions\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -26,6 +26,7 @@
 #include <libavformat/avio.h>
 #include <libavutil/avutil.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/time.h>
 #include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
 
@@ -67,6 +68,14 @@ struct _ac_data {
 	uint8_t *probe_buffer;
 	size_t probe_buffer_size;
 	size_t probe_buffer_offs;
+
+	// Source memory when opened with ac_open_memory
+	const uint8_t *mem;
+	int64_t mem_size;
+	int64_t mem_pos;
+
+	// Packages returned by ac_free_package, reused by ac_read_package
+	struct _ac_package_data *package_pool;
 };
 
 typedef struct _ac_data ac_data;
@@ -90,6 +99,10 @@ struct _ac_video_decoder {
 	AVFrame *pFrame;
 	AVFrame *pFrameRGB;
 	struct SwsContext *pSwsCtx;
+	uint8_t *own_buffer;
+	int out_width;
+	int out_height;
+	int sws_flags;
 };
 
 typedef struct _ac_video_decoder ac_video_decoder;
@@ -113,6 +126,8 @@ struct _ac_package_data {
 	ac_package package;
 	AVPacket *pPack;
 	int pts;
+	struct _ac_data *owner;
+	struct _ac_package_data *next;
 };
 
 typedef struct _ac_package_data ac_package_data;
@@ -124,6 +139,7 @@ typedef ac_package_data *lp_ac_package_data;
 
 static void ac_free_video_decoder(lp_ac_video_decoder pDecoder);
 static void ac_free_audio_decoder(lp_ac_audio_decoder pDecoder);
+static void ac_drain_package_pool(lp_ac_data self);
 
 //
 //--- Initialization and Stream opening---
@@ -190,6 +206,7 @@ void CALL_CONVT ac_free(lp_ac_instance pacInstance) {
 		// as
 		// ac_close checks the streams state
 		ac_close(pacInstance);
+		ac_drain_package_pool((lp_ac_data)pacInstance);
 		av_free((lp_ac_data)pacInstance);
 	}
 }
@@ -251,6 +268,43 @@ static int64_t io_seek(void *opaque, int64_t pos, int whence) {
 	return -1;
 }
 
+static int io_mem_read(void *opaque, uint8_t *buf, int buf_size) {
+	lp_ac_data self = ((lp_ac_data)opaque);
+	int64_t cnt = MIN((int64_t) buf_size, self->mem_size - self->mem_pos);
+	if (cnt <= 0) {
+		return AVERROR_EOF;
+	}
+
+	memcpy(buf, self->mem + self->mem_pos, cnt);
+	self->mem_pos += cnt;
+	return (int) cnt;
+}
+
+static int64_t io_mem_seek(void *opaque, int64_t pos, int whence) {
+	lp_ac_data self = ((lp_ac_data)opaque);
+	whence &= ~AVSEEK_FORCE;
+	switch (whence) {
+		case AVSEEK_SIZE:
+			return self->mem_size;
+		case SEEK_SET:
+			break;
+		case SEEK_CUR:
+			pos += self->mem_pos;
+			break;
+		case SEEK_END:
+			pos += self->mem_size;
+			break;
+		default:
+			return -1;
+	}
+
+	if (pos < 0 || pos > self->mem_size) {
+		return -1;
+	}
+	self->mem_pos = pos;
+	return pos;
+}
+
 lp_ac_proberesult CALL_CONVT ac_probe_input_buffer(uint8_t *buf, int bufsize,
                                                    char *filename,
                                                    int *score_max) {
@@ -463,6 +517,54 @@ error:
 	return -1;
 }
 
+int CALL_CONVT ac_open_memory(lp_ac_instance pacInstance, const uint8_t *data,
+                              int64_t size) {
+	// Instance cannot be opened twice!
+	if (pacInstance->opened) {
+		return -1;
+	}
+
+	// Reference at the underlying lp_ac_data instance
+	lp_ac_data self = ((lp_ac_data)pacInstance);
+
+	self->mem = data;
+	self->mem_size = size;
+	self->mem_pos = 0;
+
+	// Probe the format directly on the memory, there is no need to buffer the
+	// probed bytes for replay as the memory can simply be read again
+	int score = AVPROBE_SCORE_MAX / 4;
+	AVInputFormat *fmt;
+	ERR(fmt = (AVInputFormat *)ac_probe_input_buffer(
+	        (uint8_t *)data, MIN(size, PROBE_BUF_MAX), "", &score));
+
+	// In direct mode large reads bypass the AVIO buffer and are copied from
+	// the memory straight into the destination of the demuxer
+	ERR(self->buffer = av_malloc(AC_BUFSIZE));
+	ERR(self->pIo = avio_alloc_context(self->buffer, AC_BUFSIZE, 0, self,
+	                                   io_mem_read, 0, io_mem_seek));
+	self->pIo->seekable = 1;
+	self->pIo->direct = 1;
+
+	ERR(self->pFormatCtx = avformat_alloc_context());
+	self->pFormatCtx->pb = self->pIo;
+	AV_ERR(avformat_open_input(&(self->pFormatCtx), "", fmt, NULL));
+
+	return finalize_open(pacInstance);
+
+error:
+	ac_close(pacInstance);
+	return -1;
+}
+
+int64_t CALL_CONVT ac_get_io_position(lp_ac_instance pacInstance) {
+	lp_ac_data self = ((lp_ac_data)pacInstance);
+	if (!(pacInstance->opened) || self->pIo == NULL) {
+		return -1;
+	}
+	return avio_tell(self->pIo);
+}
+
 int CALL_CONVT ac_open_file(lp_ac_instance pacInstance, const char *filename) {
 	// Instance cannot be opened twice!
 	if (pacInstance->opened) {
@@ -503,6 +605,9 @@ void CALL_CONVT ac_close(lp_ac_instance pacInstance) {
 	self->probe_buffer = NULL;
 	self->pIo = NULL;
 	self->pFormatCtx = NULL;
+	self->mem = NULL;
+	self->mem_size = 0;
+	self->mem_pos = 0;
 	self->sender = NULL;
 	self->open_proc = NULL;
 	self->read_proc = NULL;
@@ -547,9 +652,16 @@ void CALL_CONVT ac_get_stream_info(lp_ac_instance pacInstance, int nb,
 				info->additional_info.video_info.pixel_aspect = pixel_aspect_num / pixel_aspect_den;
 			}
 
+			// The average frame rate reflects the actual frame durations of
+			// variable frame rate streams (e.g. animated GIFs, whose
+			// r_frame_rate is the 1/100 s timebase). Fall back to r_frame_rate
+			// if it is unknown.
+			AVRational rate = self->pFormatCtx->streams[nb]->avg_frame_rate;
+			if (rate.num <= 0 || rate.den <= 0) {
+				rate = self->pFormatCtx->streams[nb]->r_frame_rate;
+			}
 			info->additional_info.video_info.frames_per_second =
-			    (double)self->pFormatCtx->streams[nb]->r_frame_rate.num /
-			    (double)self->pFormatCtx->streams[nb]->r_frame_rate.den;
+			    (double)rate.num / (double)rate.den;
 			break;
 		case AVMEDIA_TYPE_AUDIO:
 			// Set stream type to "AUDIO"
@@ -603,28 +715,73 @@ void CALL_CONVT ac_get_stream_info(lp_ac_instance pacInstance, int nb,
 	}
 }
 
+void CALL_CONVT ac_set_stream_discard(lp_ac_instance pacInstance, int nb,
+                                      bool discard) {
+	if (!(pacInstance->opened) || nb < 0 || nb >= pacInstance->stream_count) {
+		return;
+	}
+
+	lp_ac_data self = ((lp_ac_data)pacInstance);
+	self->pFormatCtx->streams[nb]->discard =
+	    discard ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+}
+
 //
 //---Package management---
 //
 
-lp_ac_package CALL_CONVT ac_read_package(lp_ac_instance pacInstance) {
-	// Allocate the result packet
-	lp_ac_package_data pkt;
-	ERR(pkt = av_malloc(sizeof(ac_package_data)));
-	memset(pkt, 0, sizeof(ac_package_data));
-	ERR(pkt->pPack = av_malloc(sizeof(AVPacket)));
+// Takes a package from the pool of the instance or allocates a new one if the
+// pool is empty. In steady state every package read has been freed before, so
+// no heap allocation takes place per package.
+static lp_ac_package_data ac_alloc_package(lp_ac_data self) {
+	lp_ac_package_data pkt = self->package_pool;
+	if (pkt) {
+		self->package_pool = pkt->next;
+		pkt->next = NULL;
+		pkt->pts = 0;
+		return pkt;
+	}
 
-	pkt->pPack = av_packet_alloc();
-	pkt->pPack->data = NULL;
-	pkt->pPack->size = 0;
+	ERR(pkt = av_mallocz(sizeof(ac_package_data)));
+	ERR(pkt->pPack = av_packet_alloc());
+	pkt->owner = self;
+	return pkt;
 
-	// Try to read package
-	AV_ERR(av_read_frame(((lp_ac_data)(pacInstance))->pFormatCtx, pkt->pPack));
+error:
+	av_free(pkt);
+	return NULL;
+}
+
+static void ac_drain_package_pool(lp_ac_data self) {
+	while (self->package_pool) {
+		lp_ac_package_data pkt = self->package_pool;
+		self->package_pool = pkt->next;
+		av_packet_free(&(pkt->pPack));
+		av_free(pkt);
+	}
+}
+
+lp_ac_package CALL_CONVT ac_read_package(lp_ac_instance pacInstance) {
+	lp_ac_data self = (lp_ac_data)pacInstance;
+
+	// Fetch the result packet from the pool
+	lp_ac_package_data pkt;
+	ERR(pkt = ac_alloc_package(self));
+
+	// Try to read package. Not every demuxer honours the discard flag of a
+	// stream, so packages of discarded streams are filtered here as well.
+	AV_ERR(av_read_frame(self->pFormatCtx, pkt->pPack));
+	while (self->pFormatCtx->streams[pkt->pPack->stream_index]->discard ==
+	       AVDISCARD_ALL) {
+		av_packet_unref(pkt->pPack);
+		AV_ERR(av_read_frame(self->pFormatCtx, pkt->pPack));
+	}
 
 	if (pkt->pPack->dts != AV_NOPTS_VALUE) {
 		pkt->pts = pkt->pPack->dts;
 	}
 	pkt->package.stream_index = pkt->pPack->stream_index;
+	pkt->package.keyframe = (pkt->pPack->flags & AV_PKT_FLAG_KEY) != 0;
 	return (lp_ac_package)(pkt);
 
 error:
@@ -632,13 +789,14 @@ error:
 	return NULL;
 }
 
-// Frees the currently loaded package
+// Releases the payload of the package and returns the package to the pool of
+// the instance it was read from
 void CALL_CONVT ac_free_package(lp_ac_package pPackage) {
 	if (pPackage) {
 		lp_ac_package_data self = (lp_ac_package_data)pPackage;
 		av_packet_unref(self->pPack);
-		av_free(self->pPack);
-		av_free(self);
+		self->next = self->owner->package_pool;
+		self->owner->package_pool = self;
 	}
 }
 
@@ -653,9 +811,9 @@ static enum AVPixelFormat convert_pix_format(ac_output_format fmt) {
 		case AC_OUTPUT_BGR24:
 			return AV_PIX_FMT_BGR24;
 		case AC_OUTPUT_RGBA32:
-			return AV_PIX_FMT_RGB32;
+			return AV_PIX_FMT_RGBA;
 		case AC_OUTPUT_BGRA32:
-			return AV_PIX_FMT_BGR32;
+			return AV_PIX_FMT_BGRA;
 	}
 	return AV_PIX_FMT_RGB24;
 }
@@ -700,22 +858,26 @@ static void *ac_create_video_decoder(lp_ac_instance pacInstance,
 	ERR(pDecoder->pFrameRGB = av_frame_alloc());
 
 	pDecoder->pSwsCtx = NULL;
+	pDecoder->out_width = pDecoder->pCodecCtx->width;
+	pDecoder->out_height = pDecoder->pCodecCtx->height;
+	pDecoder->sws_flags = SWS_BICUBIC;
 
 	// Reserve buffer memory
 	enum AVPixelFormat pix_fmt_out =
 	    convert_pix_format(pacInstance->output_format);
 	pDecoder->decoder.buffer_size =
-	    av_image_get_buffer_size(pix_fmt_out, pDecoder->pCodecCtx->width,
-	                             pDecoder->pCodecCtx->height, 1);
-	ERR(pDecoder->decoder.pBuffer =
+	    av_image_get_buffer_size(pix_fmt_out, pDecoder->out_width,
+	                             pDecoder->out_height, 1);
+	ERR(pDecoder->own_buffer =
 	    (uint8_t *)av_malloc(pDecoder->decoder.buffer_size));
+	pDecoder->decoder.pBuffer = pDecoder->own_buffer;
 
 	// Link decoder to buffer
 	AVFrame *picture = (AVFrame *)(pDecoder->pFrameRGB);
 	AV_ERR(av_image_fill_arrays(picture->data, picture->linesize,
 	                            pDecoder->decoder.pBuffer, pix_fmt_out,
-	                            pDecoder->pCodecCtx->width,
-	                            pDecoder->pCodecCtx->height, 1));
+	                            pDecoder->out_width,
+	                            pDecoder->out_height, 1));
 
 	return (void *)pDecoder;
 
@@ -828,19 +990,32 @@ static int ac_decode_video_package(lp_ac_package pPackage,
 
 	AV_ERR(avcodec_receive_frame(pDecoder->pCodecCtx, pDecoder->pFrame));
 
+	// The package timecode is its decoding time, which is not the presentation
+	// time of the frame when frames are reordered
+	if (pDecoder->pFrame->best_effort_timestamp != AV_NOPTS_VALUE) {
+		AVRational timebase = ((lp_ac_data)pDecoder->decoder.pacInstance)
+		                          ->pFormatCtx->streams[pDecoder->decoder.stream_index]
+		                          ->time_base;
+		pDecoder->decoder.timecode =
+		    pDecoder->pFrame->best_effort_timestamp * av_q2d(timebase);
+	}
+
 	ERR(pDecoder->pSwsCtx = sws_getCachedContext(
 	    pDecoder->pSwsCtx, pDecoder->pCodecCtx->width,
 	    pDecoder->pCodecCtx->height, pDecoder->pCodecCtx->pix_fmt,
-	    pDecoder->pCodecCtx->width, pDecoder->pCodecCtx->height,
+	    pDecoder->out_width, pDecoder->out_height,
 	    convert_pix_format(pDecoder->decoder.pacInstance->output_format),
-	    SWS_BICUBIC, NULL, NULL, NULL));
+	    pDecoder->sws_flags, NULL, NULL, NULL));
 
+	int64_t convert_start = av_gettime_relative();
 	AV_ERR(sws_scale(pDecoder->pSwsCtx,
 	                 (const uint8_t *const *)(pDecoder->pFrame->data),
 	                 pDecoder->pFrame->linesize,
 	                 0,  //?
 	                 pDecoder->pCodecCtx->height, pDecoder->pFrameRGB->data,
 	                 pDecoder->pFrameRGB->linesize));
+	pDecoder->decoder.convert_time =
+	    (av_gettime_relative() - convert_start) / 1000000.0;
 	return 1;
 
 error:
@@ -943,6 +1118,11 @@ int CALL_CONVT ac_seek(lp_ac_decoder pDecoder, int dir, int64_t target_pos) {
 	                     pDecoder->stream_index,
 	                     av_rescale_q(pos, AV_TIME_BASE_Q, timebase),
 	                     flags));
+
+	// Frames buffered from before the seek must not come out after it
+	if (pDecoder->type == AC_DECODER_TYPE_VIDEO) {
+		avcodec_flush_buffers(((lp_ac_video_decoder)pDecoder)->pCodecCtx);
+	}
 	return 1;
 error:
 	return 0;
@@ -957,6 +1137,60 @@ error:
 	return 0;
 }
 
+int CALL_CONVT ac_set_video_buffer(lp_ac_decoder pDecoder, uint8_t *buffer) {
+	if (pDecoder->type != AC_DECODER_TYPE_VIDEO) {
+		return 0;
+	}
+
+	lp_ac_video_decoder self = (lp_ac_video_decoder)pDecoder;
+	if (buffer == NULL) {
+		buffer = self->own_buffer;
+	}
+
+	AV_ERR(av_image_fill_arrays(self->pFrameRGB->data, self->pFrameRGB->linesize,
+	                            buffer,
+	                            convert_pix_format(pDecoder->pacInstance->output_format),
+	                            self->out_width, self->out_height, 1));
+	pDecoder->pBuffer = buffer;
+	return 1;
+error:
+	return 0;
+}
+
+int CALL_CONVT ac_set_video_output_size(lp_ac_decoder pDecoder, int width,
+                                        int height, int fast) {
+	if (pDecoder->type != AC_DECODER_TYPE_VIDEO || width <= 0 || height <= 0) {
+		return 0;
+	}
+
+	lp_ac_video_decoder self = (lp_ac_video_decoder)pDecoder;
+	enum AVPixelFormat pix_fmt_out =
+	    convert_pix_format(pDecoder->pacInstance->output_format);
+	int size = av_image_get_buffer_size(pix_fmt_out, width, height, 1);
+	uint8_t *buffer;
+	ERR(buffer = (uint8_t *)av_malloc(size));
+
+	av_free(self->own_buffer);
+	self->own_buffer = buffer;
+	self->out_width = width;
+	self->out_height = height;
+	self->sws_flags = fast ? SWS_FAST_BILINEAR : SWS_BICUBIC;
+	pDecoder->buffer_size = size;
+	return ac_set_video_buffer(pDecoder, NULL);
+error:
+	return 0;
+}
+
+int CALL_CONVT ac_set_skip_nonkey(lp_ac_decoder pDecoder, int skip) {
+	if (pDecoder->type != AC_DECODER_TYPE_VIDEO) {
+		return 0;
+	}
+
+	lp_ac_video_decoder self = (lp_ac_video_decoder)pDecoder;
+	self->pCodecCtx->skip_frame = skip ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+	return 1;
+}
+
 // Free video decoder
 static void ac_free_video_decoder(lp_ac_video_decoder pDecoder) {
 	if (pDecoder) {
@@ -965,7 +1199,7 @@ static void ac_free_video_decoder(lp_ac_video_decoder pDecoder) {
 		sws_freeContext(pDecoder->pSwsCtx);
 		avcodec_close(pDecoder->pCodecCtx);
 		av_free(pDecoder->pCodecCtx);
-		av_free(pDecoder->decoder.pBuffer);
+		av_free(pDecoder->own_buffer);
 		av_free(pDecoder);
 	}
 }
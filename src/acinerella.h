@@ -71,7 +71,8 @@ typedef enum _ac_decoder_type {
 } ac_decoder_type;
 
 /**
- * Defines the format video/image data is returned in.
+ * Defines the format video/image data is returned in. The names give the byte
+ * order of a pixel in memory.
  */
 typedef enum _ac_output_format {
 	AC_OUTPUT_RGB24 = 0,
@@ -282,6 +283,12 @@ typedef struct _ac_decoder {
 	 * Size of the data in the buffer.
 	 */
 	int buffer_size;
+
+	/**
+	 * Seconds spent converting the last decoded video frame into the output
+	 * format.
+	 */
+	double convert_time;
 } ac_decoder;
 
 typedef ac_decoder *lp_ac_decoder;
@@ -292,6 +299,9 @@ typedef ac_decoder *lp_ac_decoder;
 typedef struct _ac_package {
 	/*The stream the package belongs to.*/
 	int stream_index;
+
+	/*Non-zero if the package contains a keyframe.*/
+	int keyframe;
 } ac_package;
 
 typedef ac_package *lp_ac_package;
@@ -372,6 +382,26 @@ EXTERN int CALL_CONVT
 EXTERN int CALL_CONVT
     ac_open_file(lp_ac_instance pacInstance, const char *filename);
 
+/**
+ * Opens a media stream that is completely available in memory, e.g. a mapped
+ * file. The format is probed directly on the memory and the demuxer reads from
+ * it without any callbacks. The memory must stay valid until ac_close.
+ *
+ * @param inst specifies the Acinerella Instance the stream should be opened
+ * for.
+ * @param data is a pointer at the first byte of the stream.
+ * @param size is the size of the stream in bytes.
+ */
+EXTERN int CALL_CONVT
+    ac_open_memory(lp_ac_instance pacInstance, const uint8_t *data,
+                   int64_t size);
+
+/**
+ * Returns the byte offset in the stream the demuxer is currently reading at or
+ * -1 if the instance is not opened.
+ */
+EXTERN int64_t CALL_CONVT ac_get_io_position(lp_ac_instance pacInstance);
+
 /**
  * Closes an opened media file.
  */
@@ -383,6 +413,14 @@ EXTERN void CALL_CONVT ac_close(lp_ac_instance pacInstance);
 EXTERN void CALL_CONVT ac_get_stream_info(lp_ac_instance pacInstance, int nb,
                                           lp_ac_stream_info info);
 
+/**
+ * Marks stream number "nb" as discarded. The demuxer skips the packages of
+ * discarded streams, so ac_read_package never returns them. This saves reading
+ * and allocating packages of streams the application does not decode.
+ */
+EXTERN void CALL_CONVT ac_set_stream_discard(lp_ac_instance pacInstance, int nb,
+                                             bool discard);
+
 /**
  * Reads a package from an opened media file.
  *
@@ -394,7 +432,10 @@ EXTERN void CALL_CONVT ac_get_stream_info(lp_ac_instance pacInstance, int nb,
 EXTERN lp_ac_package CALL_CONVT ac_read_package(lp_ac_instance pacInstance);
 
 /**
- * Frees a package that has been read.
+ * Frees a package that has been read. The package is returned to a pool owned
+ * by the instance it was read from and reused by the next ac_read_package
+ * call, so all packages must be freed before the instance is freed with
+ * ac_free.
  *
  * @param pPackage is a pointer at the ac_package that should be freed. May be
  * NULL in which case no operation is performed.
@@ -443,6 +484,32 @@ EXTERN void CALL_CONVT ac_free_decoder(lp_ac_decoder pDecoder);
 EXTERN int CALL_CONVT
     ac_decode_package(lp_ac_package pPackage, lp_ac_decoder pDecoder);
 
+/**
+ * Sets the buffer decoded video frames are converted into, which allows
+ * decoding directly into memory owned by the application. The buffer must hold
+ * at least buffer_size bytes and stays owned by the caller. Passing NULL
+ * restores the internal buffer of the decoder. Returns 1 on success.
+ */
+EXTERN int CALL_CONVT ac_set_video_buffer(lp_ac_decoder pDecoder,
+                                          uint8_t *buffer);
+
+/**
+ * Changes the size video frames are scaled to, the default is the size of the
+ * stream. Reallocates the internal buffer and makes it the current one, so
+ * buffers set with ac_set_video_buffer must be at least the new buffer_size.
+ * "fast" selects the cheapest scaler (fast bilinear), which is meant for
+ * previews. Returns 1 on success.
+ */
+EXTERN int CALL_CONVT ac_set_video_output_size(lp_ac_decoder pDecoder,
+                                               int width, int height, int fast);
+
+/**
+ * Lets the video decoder skip every frame that is not a keyframe, which makes
+ * decoding the keyframes of a stream (e.g. for thumbnails) much cheaper.
+ * Returns 1 on success.
+ */
+EXTERN int CALL_CONVT ac_set_skip_nonkey(lp_ac_decoder pDecoder, int skip);
+
 /**
  * Seeks to the given target position in the file. The seek funtion is not able
  * to seek a single audio/video stream but seeks the whole file forward. The
@@ -0,0 +1,387 @@
+#include <ctype.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <mupdf/fitz.h>
+#include <raylib.h>
+
+#include "archive.h"
+
+// open archives whose directory is kept
+#define ARCHIVE_OPEN 4
+// decompressed members kept for archive_read
+#define ARCHIVE_CACHED 8
+
+struct open_archive {
+	char *path;
+	fz_archive *arc;
+};
+
+struct cached_member {
+	char *path;
+	fz_buffer *buf;
+};
+
+static fz_context *ctx = NULL;
+static pthread_mutex_t fz_mutexes[FZ_LOCK_MAX];
+// archives are not thread safe, every access to them holds this lock
+static pthread_mutex_t archive_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct open_archive archives[ARCHIVE_OPEN];
+static int next_archive = 0;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_cond = PTHREAD_COND_INITIALIZER;
+static struct cached_member cache[ARCHIVE_CACHED];
+static int next_cached = 0;
+static char *queue[ARCHIVE_CACHED];
+static int queue_len = 0;
+static pthread_t prefetcher;
+static bool prefetcher_running = false;
+
+static void fz_lock_cb(void *user, int lock) {
+	(void) user;
+	pthread_mutex_lock(&fz_mutexes[lock]);
+}
+
+static void fz_unlock_cb(void *user, int lock) {
+	(void) user;
+	pthread_mutex_unlock(&fz_mutexes[lock]);
+}
+
+static pthread_once_t ctx_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ctx_key;
+
+static void archive_context_init(void) {
+	for (int i = 0; i < FZ_LOCK_MAX; i++) {
+		pthread_mutex_init(&fz_mutexes[i], NULL);
+	}
+	fz_locks_context locks = {NULL, fz_lock_cb, fz_unlock_cb};
+	ctx = fz_new_context(NULL, &locks, FZ_STORE_DEFAULT);
+	pthread_key_create(&ctx_key, (void (*)(void *)) fz_drop_context);
+}
+
+// mupdf contexts must not be shared between threads, every thread gets a clone
+static fz_context *archive_context(void) {
+	pthread_once(&ctx_once, archive_context_init);
+	fz_context *c = pthread_getspecific(ctx_key);
+	if (c == NULL) {
+		c = fz_clone_context(ctx);
+		pthread_setspecific(ctx_key, c);
+	}
+	return c;
+}
+
+// whether the first len characters of path end with an archive extension, unlike
+// IsFileExtension this is safe on the decoding threads
+static bool has_archive_extension(const char *path, size_t len) {
+	static const char *extensions[] = {".zip", ".cbz", ".tar", ".cbt"};
+	for (int i = 0; i < 4; i++) {
+		size_t n = strlen(extensions[i]);
+		if (len > n && strncasecmp(path + len - n, extensions[i], n) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool archive_is_archive(const char *path) {
+	return !archive_is_member(path) && has_archive_extension(path, strlen(path));
+}
+
+const char *archive_member_separator(const char *path) {
+	struct stat st;
+	for (const char *sep = strstr(path, ARCHIVE_SEPARATOR); sep != NULL; sep = strstr(sep + 1, ARCHIVE_SEPARATOR)) {
+		if (!has_archive_extension(path, sep - path)) {
+			continue;
+		}
+		char *archive = strndup(path, sep - path);
+		bool is_archive = stat(archive, &st) == 0 && S_ISREG(st.st_mode);
+		free(archive);
+		if (is_archive) {
+			// a file that is really named like this is not a member
+			return stat(path, &st) != 0 ? sep : NULL;
+		}
+	}
+	return NULL;
+}
+
+bool archive_is_member(const char *path) {
+	return archive_member_separator(path) != NULL;
+}
+
+// splits "<archive>::<member>", the returned archive path must be freed, NULL if path is no member
+static char *split_member(const char *path, const char **member) {
+	const char *sep = archive_member_separator(path);
+	if (sep == NULL) {
+		return NULL;
+	}
+	*member = sep + strlen(ARCHIVE_SEPARATOR);
+	return strndup(path, sep - path);
+}
+
+// called with archive_lock held
+static fz_archive *get_archive(fz_context *c, const char *path) {
+	for (int i = 0; i < ARCHIVE_OPEN; i++) {
+		if (archives[i].path != NULL && strcmp(archives[i].path, path) == 0) {
+			return archives[i].arc;
+		}
+	}
+
+	fz_archive *arc = NULL;
+	fz_try (c) {
+		arc = fz_open_archive(c, path);
+	} fz_catch (c) {
+		return NULL;
+	}
+
+	struct open_archive *slot = &archives[next_archive];
+	next_archive = (next_archive + 1) % ARCHIVE_OPEN;
+	if (slot->path != NULL) {
+		fz_drop_archive(c, slot->arc);
+		free(slot->path);
+	}
+	slot->path = strdup(path);
+	slot->arc = arc;
+	return arc;
+}
+
+// natural order, so page2 comes before page10
+static int natural_compare(const void *a, const void *b) {
+	const char *x = *(const char **) a;
+	const char *y = *(const char **) b;
+	while (*x && *y) {
+		if (isdigit((unsigned char) *x) && isdigit((unsigned char) *y)) {
+			char *xe, *ye;
+			unsigned long long nx = strtoull(x, &xe, 10);
+			unsigned long long ny = strtoull(y, &ye, 10);
+			if (nx != ny) {
+				return nx < ny ? -1 : 1;
+			}
+			x = xe;
+			y = ye;
+		} else if (*x != *y) {
+			return (unsigned char) *x - (unsigned char) *y;
+		} else {
+			x++;
+			y++;
+		}
+	}
+	return (unsigned char) *x - (unsigned char) *y;
+}
+
+static bool is_media_member(const char *name) {
+	size_t len = strlen(name);
+	return len > 0 && name[len - 1] != '/' && strncmp(name, "__MACOSX/", 9) != 0 &&
+	       !IsFileExtension(name, ".xml;.txt;.nfo;.sfv;.db");
+}
+
+int archive_list(const char *path, char ***members) {
+	fz_context *c = archive_context();
+	pthread_mutex_lock(&archive_lock);
+	fz_archive *arc = get_archive(c, path);
+	if (arc == NULL) {
+		pthread_mutex_unlock(&archive_lock);
+		return -1;
+	}
+
+	int count = fz_count_archive_entries(c, arc);
+	const char **names = malloc(count * sizeof(char *));
+	int n = 0;
+	for (int i = 0; i < count; i++) {
+		const char *name = fz_list_archive_entry(c, arc, i);
+		if (name != NULL && is_media_member(name)) {
+			names[n++] = name;
+		}
+	}
+	qsort(names, n, sizeof(char *), natural_compare);
+
+	*members = malloc(n * sizeof(char *));
+	for (int i = 0; i < n; i++) {
+		(*members)[i] = malloc(strlen(path) + strlen(ARCHIVE_SEPARATOR) + strlen(names[i]) + 1);
+		strcpy((*members)[i], path);
+		strcat((*members)[i], ARCHIVE_SEPARATOR);
+		strcat((*members)[i], names[i]);
+	}
+
+	free(names);
+	pthread_mutex_unlock(&archive_lock);
+	return n;
+}
+
+static fz_buffer *read_member(fz_context *c, const char *path) {
+	const char *member;
+	char *archive_path = split_member(path, &member);
+	fz_buffer *buf = NULL;
+	if (archive_path == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&archive_lock);
+	fz_archive *arc = get_archive(c, archive_path);
+	if (arc != NULL) {
+		fz_try (c) {
+			buf = fz_read_archive_entry(c, arc, member);
+		} fz_catch (c) {
+			buf = NULL;
+		}
+	}
+	pthread_mutex_unlock(&archive_lock);
+
+	free(archive_path);
+	return buf;
+}
+
+// called with cache_lock held, returns a new reference
+static fz_buffer *cache_lookup(fz_context *c, const char *path) {
+	for (int i = 0; i < ARCHIVE_CACHED; i++) {
+		if (cache[i].path != NULL && strcmp(cache[i].path, path) == 0) {
+			return fz_keep_buffer(c, cache[i].buf);
+		}
+	}
+	return NULL;
+}
+
+// called with cache_lock held
+static void cache_insert(fz_context *c, const char *path, fz_buffer *buf) {
+	struct cached_member *slot = &cache[next_cached];
+	next_cached = (next_cached + 1) % ARCHIVE_CACHED;
+	if (slot->path != NULL) {
+		fz_drop_buffer(c, slot->buf);
+		free(slot->path);
+	}
+	slot->path = strdup(path);
+	slot->buf = fz_keep_buffer(c, buf);
+}
+
+bool archive_read(const char *path, struct archive_data *data) {
+	fz_context *c = archive_context();
+	pthread_mutex_lock(&cache_lock);
+	fz_buffer *buf = cache_lookup(c, path);
+	pthread_mutex_unlock(&cache_lock);
+
+	if (buf == NULL) {
+		buf = read_member(c, path);
+		if (buf == NULL) {
+			return false;
+		}
+
+		pthread_mutex_lock(&cache_lock);
+		cache_insert(c, path, buf);
+		pthread_mutex_unlock(&cache_lock);
+	}
+
+	unsigned char *bytes;
+	data->size = fz_buffer_storage(c, buf, &bytes);
+	data->data = bytes;
+	data->handle = buf;
+	return true;
+}
+
+void archive_release(struct archive_data *data) {
+	if (data->handle != NULL) {
+		fz_drop_buffer(archive_context(), data->handle);
+	}
+	*data = (struct archive_data){0};
+}
+
+// a member belongs to path if path is its archive
+static bool is_member_of(const char *member, const char *path) {
+	size_t len = strlen(path);
+	return strncmp(member, path, len) == 0 && strncmp(member + len, ARCHIVE_SEPARATOR, strlen(ARCHIVE_SEPARATOR)) == 0;
+}
+
+void archive_forget(const char *path) {
+	fz_context *c = archive_context();
+	pthread_mutex_lock(&archive_lock);
+	for (int i = 0; i < ARCHIVE_OPEN; i++) {
+		if (archives[i].path != NULL && strcmp(archives[i].path, path) == 0) {
+			fz_drop_archive(c, archives[i].arc);
+			free(archives[i].path);
+			archives[i] = (struct open_archive){0};
+		}
+	}
+	pthread_mutex_unlock(&archive_lock);
+
+	// readers keep their own reference to the buffer of a dropped member
+	pthread_mutex_lock(&cache_lock);
+	for (int i = 0; i < ARCHIVE_CACHED; i++) {
+		if (cache[i].path != NULL && is_member_of(cache[i].path, path)) {
+			fz_drop_buffer(c, cache[i].buf);
+			free(cache[i].path);
+			cache[i] = (struct cached_member){0};
+		}
+	}
+	pthread_mutex_unlock(&cache_lock);
+}
+
+static void *prefetch_thread(void *arg) {
+	(void) arg;
+	fz_context *c = archive_context();
+	pthread_mutex_lock(&cache_lock);
+	for (;;) {
+		while (queue_len == 0) {
+			pthread_cond_wait(&cache_cond, &cache_lock);
+		}
+
+		char *path = queue[0];
+		memmove(queue, queue + 1, --queue_len * sizeof(char *));
+		fz_buffer *buf = cache_lookup(c, path);
+		pthread_mutex_unlock(&cache_lock);
+
+		if (buf == NULL) {
+			buf = read_member(c, path);
+			pthread_mutex_lock(&cache_lock);
+			if (buf != NULL) {
+				cache_insert(c, path, buf);
+			}
+			pthread_mutex_unlock(&cache_lock);
+		}
+
+		fz_drop_buffer(c, buf);
+		free(path);
+		pthread_mutex_lock(&cache_lock);
+	}
+	return NULL;
+}
+
+void archive_prefetch(const char *path) {
+	if (!archive_is_member(path)) {
+		return;
+	}
+
+	pthread_mutex_lock(&cache_lock);
+	if (!prefetcher_running) {
+		prefetcher_running = pthread_create(&prefetcher, NULL, prefetch_thread, NULL) == 0;
+	}
+
+	// the oldest request is dropped when the queue is full, it is the least likely to be needed
+	if (queue_len == ARCHIVE_CACHED) {
+		free(queue[0]);
+		memmove(queue, queue + 1, --queue_len * sizeof(char *));
+	}
+	queue[queue_len++] = strdup(path);
+	pthread_cond_signal(&cache_cond);
+	pthread_mutex_unlock(&cache_lock);
+}
+
+int archive_expand(const char **paths, int n, const char ***expanded) {
+	int count = 0;
+	*expanded = malloc(n * sizeof(char *));
+	for (int i = 0; i < n; i++) {
+		char **members = NULL;
+		int n_members = archive_is_archive(paths[i]) ? archive_list(paths[i], &members) : -1;
+		if (n_members <= 0) {
+			(*expanded)[count++] = strdup(paths[i]);
+			continue;
+		}
+
+		*expanded = realloc(*expanded, (n + count + n_members) * sizeof(char *));
+		for (int j = 0; j < n_members; j++) {
+			(*expanded)[count++] = members[j];
+		}
+		free(members);
+	}
+	return count;
+}
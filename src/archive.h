@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Members of zip/cbz/tar archives are shown as separate media with the path
+// "<archive>::<member>". The directory of an archive is read once, members are
+// decompressed on demand into memory the modules decode from.
+
+#define ARCHIVE_SEPARATOR "::"
+
+struct archive_data {
+	const unsigned char *data;
+	size_t size;
+	void *handle;
+};
+
+bool archive_is_archive(const char *path);
+// a path is a member if the part before a separator is an existing archive and the path
+// itself does not exist
+bool archive_is_member(const char *path);
+// the separator after the archive of a member path, NULL if path is no member
+const char *archive_member_separator(const char *path);
+// member paths of the archive in natural order, returns the count or -1 on failure
+int archive_list(const char *path, char ***members);
+// decompresses the member, data stays valid until archive_release
+bool archive_read(const char *path, struct archive_data *data);
+void archive_release(struct archive_data *data);
+// decompresses the member in the background so a later archive_read finds it ready
+void archive_prefetch(const char *path);
+// drops the directory and the decompressed members of the archive at path after it changed
+void archive_forget(const char *path);
+// replaces every archive by its members, other paths are copied; returns the count, the array
+// and its strings are owned by the caller
+int archive_expand(const char **paths, int n, const char ***expanded);
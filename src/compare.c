@@ -0,0 +1,171 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "compare.h"
+#include "module.h"
+#include "perf.h"
+#include "pixel.h"
+
+// differences are doubled this many times, renders that differ by a few levels stay visible
+#define COMPARE_GAIN 3
+
+struct compare_job {
+	pthread_t thread;
+	bool started;
+	const char *path;
+	Image image;
+	bool ok;
+};
+
+static void *compare_decode_thread(void *arg) {
+	struct compare_job *job = arg;
+	job->ok = image_decode(job->path, &job->image);
+	if (job->ok && job->image.format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) {
+		ImageFormat(&job->image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+	}
+	return NULL;
+}
+
+bool compare_open(struct compare *compare, const char **paths, int count) {
+	*compare = (struct compare){0};
+	if (count > COMPARE_MAX) {
+		count = COMPARE_MAX;
+	}
+
+	struct compare_job jobs[COMPARE_MAX] = {0};
+	for (int i = 0; i < count; i++) {
+		jobs[i].path = paths[i];
+		jobs[i].started = pthread_create(&jobs[i].thread, NULL, compare_decode_thread, &jobs[i]) == 0;
+		if (!jobs[i].started) {
+			compare_decode_thread(&jobs[i]);
+		}
+	}
+
+	// only the uploads are left to the main thread
+	for (int i = 0; i < count; i++) {
+		if (jobs[i].started) {
+			pthread_join(jobs[i].thread, NULL);
+		}
+		if (!jobs[i].ok) {
+			continue;
+		}
+
+		int n = compare->count++;
+		compare->paths[n] = jobs[i].path;
+		compare->images[n] = jobs[i].image;
+		compare->textures[n] = perf_load_texture(jobs[i].image);
+	}
+
+	if (compare->count < 2) {
+		compare_close(compare);
+		return false;
+	}
+	return true;
+}
+
+void compare_close(struct compare *compare) {
+	for (int i = 0; i < compare->count; i++) {
+		perf_unload_texture(compare->textures[i]);
+		UnloadImage(compare->images[i]);
+	}
+	perf_unload_texture(compare->diff);
+	*compare = (struct compare){0};
+}
+
+void compare_flicker(struct compare *compare) {
+	if (compare->view != COMPARE_FLICKER) {
+		compare->view = COMPARE_FLICKER;
+		compare->shown = 0;
+	} else if (++compare->shown == compare->count) {
+		compare->view = COMPARE_SPLIT;
+	}
+}
+
+// images of different sizes are compared where they overlap at the top left
+static void compare_make_diff(struct compare *compare) {
+	Image *a = &compare->images[0];
+	Image *b = &compare->images[1];
+	int w = a->width < b->width ? a->width : b->width;
+	int h = a->height < b->height ? a->height : b->height;
+	uint8_t *pixels = malloc((size_t) w * h * 4);
+
+	double start = perf_now();
+	for (int y = 0; y < h; y++) {
+		const uint8_t *row_a = (const uint8_t *) a->data + (size_t) y * a->width * 4;
+		const uint8_t *row_b = (const uint8_t *) b->data + (size_t) y * b->width * 4;
+		pixel_absdiff(pixels + (size_t) y * w * 4, row_a, row_b, w, COMPARE_GAIN);
+	}
+	perf_record(PERF_CONVERT, start);
+
+	Image diff = {
+		.data = pixels,
+		.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+		.width = w,
+		.height = h,
+		.mipmaps = 1,
+	};
+	compare->diff = perf_load_texture(diff);
+	free(pixels);
+}
+
+void compare_toggle_diff(struct compare *compare) {
+	if (compare->view == COMPARE_DIFF) {
+		compare->view = COMPARE_SPLIT;
+		return;
+	}
+
+	if (compare->diff.id == 0) {
+		compare_make_diff(compare);
+	}
+	compare->view = COMPARE_DIFF;
+}
+
+static void draw_fitted(Texture2D t) {
+	int w = GetScreenWidth();
+	int h = GetScreenHeight();
+	float scale = fminf(w / (float) t.width, h / (float) t.height);
+	Vector2 pos = {(w - t.width * scale) / 2, (h - t.height * scale) / 2};
+	DrawTextureEx(t, pos, 0, scale, WHITE);
+}
+
+void compare_draw(struct compare *compare) {
+	switch (compare->view) {
+		case COMPARE_SPLIT: {
+			// every image is drawn where it would be on its own and clipped to its strip
+			int w = GetScreenWidth();
+			for (int i = 0; i < compare->count; i++) {
+				int x = w * i / compare->count;
+				BeginScissorMode(x, 0, w * (i + 1) / compare->count - x, GetScreenHeight());
+				draw_fitted(compare->textures[i]);
+				EndScissorMode();
+			}
+			break;
+		}
+		case COMPARE_FLICKER: draw_fitted(compare->textures[compare->shown]); break;
+		case COMPARE_DIFF: draw_fitted(compare->diff); break;
+	}
+}
+
+const char *compare_text(struct compare *compare) {
+	static char text[1024];
+	switch (compare->view) {
+		case COMPARE_SPLIT: {
+			int len = snprintf(text, sizeof(text), "compare: %s", compare->paths[0]);
+			for (int i = 1; i < compare->count && len < (int) sizeof(text); i++) {
+				len += snprintf(text + len, sizeof(text) - len, " | %s", compare->paths[i]);
+			}
+			break;
+		}
+		case COMPARE_FLICKER: {
+			snprintf(text, sizeof(text), "compare %d/%d: %s", compare->shown + 1, compare->count, compare->paths[compare->shown]);
+			break;
+		}
+		case COMPARE_DIFF: {
+			snprintf(text, sizeof(text), "difference x%d: %s - %s", 1 << COMPARE_GAIN, compare->paths[0], compare->paths[1]);
+			break;
+		}
+	}
+	return text;
+}
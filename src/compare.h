@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <raylib.h>
+
+// Compares still images shown with the same camera: in strips side by side, one at a time
+// in place (flicker) or as the difference of the first two. The images are decoded on one
+// thread each, so opening a comparison takes about as long as opening a single image.
+
+#define COMPARE_MAX 4
+
+enum compare_view {
+	COMPARE_SPLIT,
+	COMPARE_FLICKER,
+	COMPARE_DIFF,
+};
+
+struct compare {
+	// 0 while no comparison is shown
+	int count;
+	const char *paths[COMPARE_MAX];
+	// kept as 4 byte pixels for the difference
+	Image images[COMPARE_MAX];
+	Texture2D textures[COMPARE_MAX];
+	enum compare_view view;
+	// image shown in place by the flicker view
+	int shown;
+	// difference of the first two images, id 0 until it is shown the first time
+	Texture2D diff;
+};
+
+// false if fewer than two of the paths are still images
+bool compare_open(struct compare *compare, const char **paths, int count);
+void compare_close(struct compare *compare);
+// from the split view to every image in turn and back to the split view
+void compare_flicker(struct compare *compare);
+void compare_toggle_diff(struct compare *compare);
+// draws fitted to the screen, inside the 2d mode of the camera the images share
+void compare_draw(struct compare *compare);
+const char *compare_text(struct compare *compare);
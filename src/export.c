@@ -0,0 +1,354 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <raylib.h>
+
+#include "archive.h"
+#include "export.h"
+#include "module.h"
+
+#define EXPORT_DEFAULT_DPI 150
+#define EXPORT_DEFAULT_OUTPUT "{name}-{index}.png"
+
+enum export_kind {
+	EXPORT_IMAGE,
+	EXPORT_PAGE,
+	EXPORT_FRAME,
+};
+
+struct export_job {
+	const char *path;
+	enum export_kind kind;
+	// page from 0 for documents
+	int page;
+	double seconds;
+	// video frame instead of seconds, -1 if not given
+	int frame;
+	// NULL when written to stdout
+	char *output;
+	bool ppm;
+
+	// encoded output for stdout, handed to the main thread in job order
+	unsigned char *data;
+	size_t size;
+	bool failed;
+	atomic_bool done;
+};
+
+struct export {
+	struct export_job *jobs;
+	int njobs;
+	atomic_int next;
+	bool to_stdout;
+	float dpi;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static void export_usage(void) {
+	fprintf(stderr, "Usage: imgview --export [options] [images/pdfs/videos/archives...]\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  --pages <n>[-<m>]|all: pages of documents, from 1 (default 1)\n");
+	fprintf(stderr, "  --time <seconds>: time of the exported video frame (default 0)\n");
+	fprintf(stderr, "  --frame <n>: number of the exported video frame instead of a time\n");
+	fprintf(stderr, "  --dpi <dpi>: resolution of document pages (default %d)\n", EXPORT_DEFAULT_DPI);
+	fprintf(stderr, "  --output <pattern>: file of each output, {name} is the input file name without extension\n");
+	fprintf(stderr, "      and {index} the page, the frame or time in ms of videos or 1, - writes to stdout\n");
+	fprintf(stderr, "      (default %s)\n", EXPORT_DEFAULT_OUTPUT);
+	fprintf(stderr, "  --format png|ppm: format written to stdout, files use their extension (default ppm)\n");
+	fprintf(stderr, "  --jobs <n>: worker threads (default the number of cpus)\n");
+}
+
+// the pattern with {name} and {index} replaced
+static char *output_path(const char *pattern, const char *path, int index) {
+	// members are named after their own file name in the archive
+	const char *separator = archive_member_separator(path);
+	const char *name = separator != NULL ? separator + strlen(ARCHIVE_SEPARATOR) : path;
+	const char *base = strrchr(name, '/');
+	base = base != NULL ? base + 1 : name;
+	const char *dot = strrchr(base, '.');
+	int name_len = dot != NULL && dot != base ? dot - base : (int) strlen(base);
+
+	size_t cap = strlen(pattern) + 1;
+	for (const char *p = strchr(pattern, '{'); p != NULL; p = strchr(p + 1, '{')) {
+		cap += name_len + 16;
+	}
+
+	char *out = malloc(cap);
+	size_t len = 0;
+	for (const char *p = pattern; *p != '\0';) {
+		if (strncmp(p, "{name}", 6) == 0) {
+			len += snprintf(out + len, cap - len, "%.*s", name_len, base);
+			p += 6;
+		} else if (strncmp(p, "{index}", 7) == 0) {
+			len += snprintf(out + len, cap - len, "%d", index);
+			p += 7;
+		} else {
+			out[len++] = *p++;
+		}
+	}
+	out[len] = '\0';
+	return out;
+}
+
+// binary ppm of the color channels, alpha is dropped
+static unsigned char *encode_ppm(Image *image, size_t *size) {
+	if (image->format != PIXELFORMAT_UNCOMPRESSED_R8G8B8) {
+		ImageFormat(image, PIXELFORMAT_UNCOMPRESSED_R8G8B8);
+	}
+
+	char header[64];
+	int header_len = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", image->width, image->height);
+	size_t pixels = (size_t) image->width * image->height * 3;
+	unsigned char *data = malloc(header_len + pixels);
+	memcpy(data, header, header_len);
+	memcpy(data + header_len, image->data, pixels);
+	*size = header_len + pixels;
+	return data;
+}
+
+static unsigned char *encode_png(Image *image, size_t *size) {
+	int format = image->format;
+	if (format != PIXELFORMAT_UNCOMPRESSED_R8G8B8 && format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 &&
+	    format != PIXELFORMAT_UNCOMPRESSED_GRAYSCALE && format != PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA) {
+		ImageFormat(image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+	}
+
+	// unlike ExportImage, this does not go through raylib's static buffers for the extension
+	int n = 0;
+	unsigned char *png = ExportImageToMemory(*image, ".png", &n);
+	if (png == NULL) {
+		return NULL;
+	}
+	unsigned char *data = malloc(n);
+	memcpy(data, png, n);
+	MemFree(png);
+	*size = n;
+	return data;
+}
+
+static bool render_job(struct export *export, struct export_job *job, Image *image) {
+	switch (job->kind) {
+		case EXPORT_PAGE: return pdf_export_page(job->path, job->page, export->dpi, image);
+		case EXPORT_FRAME: return video_export_frame(job->path, job->seconds, job->frame, image);
+		case EXPORT_IMAGE: {
+			// animated images are decoded by the video module, like in the viewer
+			return image_decode(job->path, image) || video_export_frame(job->path, job->seconds, job->frame, image);
+		}
+	}
+	return false;
+}
+
+static bool write_file(const char *path, const unsigned char *data, size_t size) {
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		perror(path);
+		return false;
+	}
+	bool ok = fwrite(data, 1, size, f) == size;
+	return fclose(f) == 0 && ok;
+}
+
+static void run_job(struct export *export, struct export_job *job) {
+	Image image = {0};
+	if (!render_job(export, job, &image)) {
+		fprintf(stderr, "%s: unable to render\n", job->path);
+		job->failed = true;
+		return;
+	}
+
+	job->data = job->ppm ? encode_ppm(&image, &job->size) : encode_png(&image, &job->size);
+	UnloadImage(image);
+	if (job->data == NULL) {
+		fprintf(stderr, "%s: unable to encode\n", job->path);
+		job->failed = true;
+		return;
+	}
+
+	if (job->output != NULL) {
+		job->failed = !write_file(job->output, job->data, job->size);
+		free(job->data);
+		job->data = NULL;
+	}
+}
+
+static void *export_thread(void *arg) {
+	struct export *export = arg;
+	for (;;) {
+		int i = atomic_fetch_add(&export->next, 1);
+		if (i >= export->njobs) {
+			break;
+		}
+
+		struct export_job *job = &export->jobs[i];
+		run_job(export, job);
+		pthread_mutex_lock(&export->lock);
+		atomic_store(&job->done, true);
+		pthread_cond_broadcast(&export->cond);
+		pthread_mutex_unlock(&export->lock);
+	}
+	pdf_export_done();
+	return NULL;
+}
+
+static void add_job(struct export *export, struct export_job job) {
+	export->jobs = realloc(export->jobs, (export->njobs + 1) * sizeof(struct export_job));
+	export->jobs[export->njobs++] = job;
+}
+
+// parses "n", "n-m" or "all" into pages from 0, last is -1 for the end of the document
+static bool parse_pages(const char *arg, int *first, int *last) {
+	if (strcmp(arg, "all") == 0) {
+		*first = 0;
+		*last = -1;
+		return true;
+	}
+
+	char *end;
+	*first = strtol(arg, &end, 10) - 1;
+	*last = *first;
+	if (*end == '-') {
+		*last = strtol(end + 1, &end, 10) - 1;
+	}
+	return *end == '\0' && *first >= 0 && *last >= *first;
+}
+
+int export_main(int argc, const char **argv) {
+	const char *output = EXPORT_DEFAULT_OUTPUT;
+	int first_page = 0;
+	int last_page = 0;
+	double seconds = 0;
+	int frame = -1;
+	int njobs = sysconf(_SC_NPROCESSORS_ONLN);
+	bool ppm = true;
+	struct export export = {.dpi = EXPORT_DEFAULT_DPI};
+
+	int argi = 0;
+	for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+		const char *value = argi + 1 < argc ? argv[argi + 1] : NULL;
+		bool ok = value != NULL;
+		if (ok && strcmp(argv[argi], "--pages") == 0) {
+			ok = parse_pages(value, &first_page, &last_page);
+		} else if (ok && strcmp(argv[argi], "--time") == 0) {
+			seconds = atof(value);
+		} else if (ok && strcmp(argv[argi], "--frame") == 0) {
+			frame = atoi(value);
+		} else if (ok && strcmp(argv[argi], "--dpi") == 0) {
+			export.dpi = atof(value);
+			ok = export.dpi > 0;
+		} else if (ok && strcmp(argv[argi], "--output") == 0) {
+			output = value;
+		} else if (ok && strcmp(argv[argi], "--format") == 0) {
+			ppm = strcmp(value, "ppm") == 0;
+			ok = ppm || strcmp(value, "png") == 0;
+		} else if (ok && strcmp(argv[argi], "--jobs") == 0) {
+			njobs = atoi(value);
+			ok = njobs > 0;
+		} else {
+			ok = false;
+		}
+
+		if (!ok) {
+			export_usage();
+			return 1;
+		}
+		argi++;
+	}
+	if (argi >= argc) {
+		export_usage();
+		return 1;
+	}
+
+	// raylib logs to stdout, which may carry the output
+	SetTraceLogLevel(LOG_NONE);
+	export.to_stdout = strcmp(output, "-") == 0;
+
+	// documents that cannot be exported at all are failures as much as pages that fail
+	int failed = 0;
+	const char **paths;
+	int npaths = archive_expand(argv + argi, argc - argi, &paths);
+	// the jobs are planned on this thread, IsFileExtension is not thread safe
+	for (int i = 0; i < npaths; i++) {
+		struct export_job job = {.path = paths[i], .kind = EXPORT_IMAGE, .seconds = seconds, .frame = frame};
+		if (IsFileExtension(paths[i], DOCUMENT_EXTENSIONS)) {
+			// counted here, which also creates the shared mupdf context before the workers
+			int n = pdf_export_count(paths[i]);
+			int last = last_page < 0 || last_page >= n ? n - 1 : last_page;
+			for (int page = first_page; page <= last; page++) {
+				job.kind = EXPORT_PAGE;
+				job.page = page;
+				job.output = export.to_stdout ? NULL : output_path(output, paths[i], page + 1);
+				job.ppm = export.to_stdout ? ppm : IsFileExtension(job.output, ".ppm");
+				add_job(&export, job);
+			}
+			if (n < 0) {
+				fprintf(stderr, "%s: unable to open\n", paths[i]);
+				failed++;
+			} else if (n <= first_page) {
+				fprintf(stderr, "%s: no page %d\n", paths[i], first_page + 1);
+				failed++;
+			}
+			continue;
+		}
+
+		int index = 1;
+		if (IsFileExtension(paths[i], VIDEO_EXTENSIONS)) {
+			job.kind = EXPORT_FRAME;
+			index = frame >= 0 ? frame : seconds * 1000;
+		}
+		job.output = export.to_stdout ? NULL : output_path(output, paths[i], index);
+		job.ppm = export.to_stdout ? ppm : IsFileExtension(job.output, ".ppm");
+		add_job(&export, job);
+	}
+	pdf_export_done();
+
+	pthread_mutex_init(&export.lock, NULL);
+	pthread_cond_init(&export.cond, NULL);
+	if (njobs > export.njobs) {
+		njobs = export.njobs;
+	}
+	pthread_t *threads = calloc(njobs, sizeof(pthread_t));
+	int started = 0;
+	for (int i = 0; i < njobs; i++) {
+		if (pthread_create(&threads[started], NULL, export_thread, &export) == 0) {
+			started++;
+		}
+	}
+	if (started == 0) {
+		export_thread(&export);
+	}
+
+	// stdout gets the outputs in order while later ones are still being rendered
+	for (int i = 0; i < export.njobs; i++) {
+		struct export_job *job = &export.jobs[i];
+		pthread_mutex_lock(&export.lock);
+		while (!atomic_load(&job->done)) {
+			pthread_cond_wait(&export.cond, &export.lock);
+		}
+		pthread_mutex_unlock(&export.lock);
+
+		failed += job->failed;
+		if (job->data != NULL) {
+			fwrite(job->data, 1, job->size, stdout);
+			fflush(stdout);
+			free(job->data);
+		}
+		free(job->output);
+	}
+
+	for (int i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	free(export.jobs);
+	for (int i = 0; i < npaths; i++) {
+		free((char *) paths[i]);
+	}
+	free(paths);
+	pthread_mutex_destroy(&export.lock);
+	pthread_cond_destroy(&export.cond);
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Headless batch export: renders pdf pages, video frames and images with the same modules
+// as the viewer, but to png/ppm files or stdout and without a window. Files and pages are
+// spread over a pool of worker threads, stdout receives the outputs in argument order.
+
+// runs an export with the arguments after --export, returns the exit status
+int export_main(int argc, const char **argv);
@@ -1,7 +1,14 @@
 #include <raylib.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 
+#include "archive.h"
 #include "module.h"
+#include "perf.h"
+#include "pixel.h"
+#include "stream.h"
 
 static const char *image_text(struct media *self) {
 	(void) self;
@@ -14,22 +21,215 @@ static void image_set_index(struct media *self, int index_mode, int amount) {
 	(void) amount;
 }
 
-static bool image_try_open(struct media *media, const char *mediapath) {
+static void gif_skip_sub_blocks(FILE *f) {
+	int size;
+	while ((size = fgetc(f)) > 0) {
+		fseek(f, size, SEEK_CUR);
+	}
+}
+
+// walks the gif blocks until a second image descriptor is found
+static bool gif_is_animated(FILE *f) {
+	unsigned char header[13];
+	if (fread(header, 1, sizeof(header), f) != sizeof(header)) {
+		return false;
+	}
+	if (header[10] & 0x80) {
+		fseek(f, 3 << ((header[10] & 7) + 1), SEEK_CUR);
+	}
+
+	int frames = 0;
+	for (;;) {
+		switch (fgetc(f)) {
+			case 0x21: {
+				fgetc(f);
+				gif_skip_sub_blocks(f);
+				break;
+			}
+			case 0x2c: {
+				unsigned char desc[9];
+				if (++frames > 1) {
+					return true;
+				}
+				if (fread(desc, 1, sizeof(desc), f) != sizeof(desc)) {
+					return false;
+				}
+				if (desc[8] & 0x80) {
+					fseek(f, 3 << ((desc[8] & 7) + 1), SEEK_CUR);
+				}
+				fgetc(f);
+				gif_skip_sub_blocks(f);
+				break;
+			}
+			default: return false;
+		}
+	}
+}
+
+// an apng has an acTL chunk before the first IDAT chunk
+static bool png_is_animated(FILE *f) {
+	fseek(f, 8, SEEK_SET);
+	unsigned char chunk[8];
+	while (fread(chunk, 1, sizeof(chunk), f) == sizeof(chunk)) {
+		if (memcmp(chunk + 4, "acTL", 4) == 0) {
+			return true;
+		} else if (memcmp(chunk + 4, "IDAT", 4) == 0) {
+			return false;
+		}
+		long len = (long) chunk[0] << 24 | chunk[1] << 16 | chunk[2] << 8 | chunk[3];
+		fseek(f, len + 4, SEEK_CUR);
+	}
+	return false;
+}
+
+// animated images are played by the video module, which decodes them frame by frame
+static bool image_is_animated(FILE *f) {
+	if (f == NULL) {
+		return false;
+	}
+
+	unsigned char magic[21] = {0};
+	size_t n = fread(magic, 1, sizeof(magic), f);
+	rewind(f);
+
+	bool animated = false;
+	if (n >= 6 && memcmp(magic, "GIF8", 4) == 0) {
+		animated = gif_is_animated(f);
+	} else if (n >= 8 && memcmp(magic, "\x89PNG", 4) == 0) {
+		animated = png_is_animated(f);
+	} else if (n == sizeof(magic) && memcmp(magic, "RIFF", 4) == 0 && memcmp(magic + 8, "WEBPVP8X", 8) == 0) {
+		animated = magic[20] & 0x02;
+	}
+
+	return animated;
+}
+
+// every uncompressed format is uploaded as 4 byte aligned RGBA, compressed ones are left to the gpu
+static void image_to_rgba(Image *image) {
+	if (image->format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 || image->format >= PIXELFORMAT_COMPRESSED_DXT1_RGB) {
+		return;
+	}
+
+	double start = perf_now();
+	size_t npixels = (size_t) image->width * image->height;
+	uint8_t *rgba = NULL;
+	if (image->format == PIXELFORMAT_UNCOMPRESSED_R8G8B8) {
+		rgba = malloc(npixels * 4);
+		pixel_to_rgba(rgba, image->data, npixels, PIXEL_RGB);
+	} else if (image->format == PIXELFORMAT_UNCOMPRESSED_GRAYSCALE || image->format == PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA) {
+		rgba = malloc(npixels * 4);
+		pixel_gray_to_rgba(rgba, image->data, npixels, image->format == PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA);
+	}
+
+	if (rgba != NULL) {
+		UnloadImage(*image);
+		image->data = rgba;
+		image->format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+	} else {
+		// 16 bit packed, 16 bit and float formats are rare, raylib converts them
+		ImageFormat(image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+	}
+	perf_record(PERF_CONVERT, start);
+}
+
+// formats enabled in raylib-options.patch, LoadImage picks the loader by extension anyway
+#define IMAGE_EXTENSIONS ".png;.dds;.hdr;.pic;.ppm;.pgm;.pnm;.ktx;.ktx2;.astc;.bmp;.tga;.jpg;.jpeg;.gif;.qoi;.psd;.pkm;.pvr;.svg"
+
+// IsFileExtension lowercases into a static buffer, but images are decoded on several threads
+static bool has_extension(const char *path, const char *extensions) {
+	const char *ext = strrchr(path, '.');
+	if (ext == NULL) {
+		return false;
+	}
+
+	size_t len = strlen(ext);
+	for (const char *e = extensions; *e != '\0';) {
+		size_t n = strcspn(e, ";");
+		if (n == len && strncasecmp(e, ext, n) == 0) {
+			return true;
+		}
+		e += n + (e[n] == ';');
+	}
+	return false;
+}
+
+// decodes still images from files or archive members, animated ones are left to the video module;
+// needs no gl context, so several images can be decoded on threads at once
+bool image_decode(const char *mediapath, Image *image) {
+	// streams are only read once they start with an image format and are kept in memory
+	const char *type = GetFileExtension(mediapath);
+	const unsigned char *data = NULL;
+	size_t size = 0;
+	struct archive_data member = {0};
+	if (stream_is_stream(mediapath)) {
+		struct stream *stream = stream_get(mediapath);
+		type = stream != NULL ? stream_image_type(stream) : NULL;
+		if (type == NULL || !stream_read_all(stream, &data, &size)) {
+			return false;
+		}
+	} else if (!has_extension(mediapath, IMAGE_EXTENSIONS)) {
+		// LoadImage reads the whole file before checking the extension, which is slow for large videos
+		return false;
+	} else if (archive_is_member(mediapath)) {
+		if (!archive_read(mediapath, &member)) {
+			return false;
+		}
+		data = member.data;
+		size = member.size;
+	}
+
+	FILE *f = data ? fmemopen((void *) data, size, "rb") : fopen(mediapath, "rb");
+	bool animated = image_is_animated(f);
+	if (f != NULL) {
+		fclose(f);
+	}
+	if (animated) {
+		archive_release(&member);
+		return false;
+	}
+
+	double start = perf_now();
+	if (data) {
+		*image = LoadImageFromMemory(type, data, size);
+	} else {
+		*image = LoadImage(mediapath);
+	}
+	archive_release(&member);
+	if (image->data == NULL) {
+		return false;
+	}
+	perf_record(PERF_DECODE, start);
+
+	image_to_rgba(image);
+	return true;
+}
+
+static void image_close(struct media *self) {
+	perf_unload_texture(self->texture);
+	*self = (struct media){0};
+}
+
+void image_open_decoded(struct media *media, Image image) {
 	static struct media media_template = {
 		.text = image_text,
 		.set_index = image_set_index,
+		.close = image_close,
 		.userdata = NULL,
 		.texture = {0},
 	};
 
-	Image i = LoadImage(mediapath);
-	if (i.data == NULL) {
+	*media = media_template;
+	media->texture = perf_load_texture(image);
+	UnloadImage(image);
+}
+
+static bool image_try_open(struct media *media, const char *mediapath) {
+	Image i;
+	if (!image_decode(mediapath, &i)) {
 		return false;
 	}
 
-	*media = media_template;
-	media->texture = LoadTextureFromImage(i);
-	UnloadImage(i);
+	image_open_decoded(media, i);
 	return true;
 }
 
@@ -1,70 +1,768 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <raylib.h>
 #include <raymath.h>
 
+#include "archive.h"
+#include "compare.h"
+#include "export.h"
 #include "module.h"
+#include "perf.h"
+#include "server.h"
+#include "stream.h"
+#include "trace.h"
+#include "watch.h"
 
 struct module image_init(void);
 struct module pdf_init(void);
 struct module video_init(void);
 struct module fallback_init(void);
 
+static struct module (*module_inits[])(void) = {image_init, pdf_init, video_init, fallback_init};
+
 #define N_MODULES 4
 #define MOD_INDEX_IMAGE 0
 #define MOD_INDEX_PDF 1
 #define MOD_INDEX_VIDEO 2
 #define MOD_INDEX_FALLBACK 3
 
+// entries after the current one whose files are pulled into the page cache
+#define PREFETCH_AHEAD 3
+// advised entries further away than this are dropped from the page cache again
+#define PREFETCH_KEEP 8
+// bytes of a video that are advised, enough for its header and first frames; the rest is
+// read while it plays and would only push other files out of the page cache
+#define PREFETCH_VIDEO_BYTES (8 << 20)
+
+// bytes of text the prompt takes
+#define PROMPT_MAX 256
+
+// pixels scrolled per wheel step
+#define SCROLL_STEP 120
+
+// height of the timeline of videos and of the area at the bottom where it reacts to the mouse
+#define TIMELINE_HEIGHT 6
+#define TIMELINE_HOVER 40
+
+// frame rate videos that do not tell theirs are played at
+#define PLAY_FALLBACK_FPS 30
+
+// medias shown side by side in the multi-view and the frame rate it is drawn at while playing
+#define GRID_MAX 16
+#define GRID_FPS 60
+
+// seconds a slide is shown when no interval is given, the crossfade into the next slide
+// takes at most SLIDESHOW_FADE and a slide shown SLIDESHOW_LATE after its deadline is reported
+#define SLIDESHOW_INTERVAL 5.0
+#define SLIDESHOW_FADE 0.5
+#define SLIDESHOW_LATE 0.02
+#define SLIDESHOW_FPS 60
+
+#define OUTLINE_WIDTH 500
+#define OUTLINE_TOP 24
+#define OUTLINE_ROW 22
+
+#define FONT_PATH "/home/oskar/.local/share/fonts/NotoSansMonoNerd.ttf"
+#define FONT_SIZE 32
+#define FONT_GLYPHS 95
+#define FONT_PADDING 4
+
+// glyphs are rasterized on a thread, only the texture upload needs the gl context
+struct font_loader {
+	pthread_t thread;
+	atomic_bool done;
+	Font font;
+	Image atlas;
+};
+
+// a changed image is decoded again on a thread and only replaces the shown texture once
+// it is complete, so a file that cannot be read yet keeps showing its previous version
+struct reloader {
+	pthread_t thread;
+	bool running;
+	atomic_bool done;
+	// the file changed again while it was decoded
+	bool again;
+	int media;
+	char *path;
+	Image image;
+	bool ok;
+};
+
+// advances through the media list on a fixed schedule; the next slide is opened while the
+// current one is shown, images are decoded on a thread, so that the change at the deadline
+// only swaps medias that are already open
+struct slideshow {
+	bool running;
+	double interval;
+	// time the current slide is replaced at, later deadlines follow from it, not from the
+	// time a slide was actually shown
+	double deadline;
+
+	// slide opened ahead, -1 before it is started, ready once it can be shown
+	int next;
+	int next_module;
+	bool next_ready;
+	pthread_t decoder;
+	bool decoding;
+	atomic_bool decoded;
+	bool decode_ok;
+	const char *path;
+	Image image;
+
+	// slide faded out, -1 while no fade is running
+	int previous;
+	double fade_start;
+
+	// wakes the main loop at the deadline while it waits for events, runs while the
+	// slideshow does
+	pthread_t timer;
+	bool timer_started;
+	bool timer_stop;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	double wake_at;
+};
+
 struct state {
 	struct module modules[N_MODULES];
+	bool modules_ready[N_MODULES];
 	struct media *medias;
 	int n_medias;
 	const char **media_paths;
+	bool *media_advised;
 	int current_media;
+	// module that opened the current media, -1 if none could
+	int current_module;
+	struct reloader reloader;
 
 	Camera2D camera;
 	Font font;
+	struct font_loader font_loader;
+	bool font_loaded;
 
 	bool zoom;
+	bool server;
 	bool is_video;
 	bool video_running;
+	// frames stepped per tick while playing, -1 plays backwards
+	int play_direction;
+	// seconds played since the last frame of a video slower than 1 fps
+	double play_time;
+	// the frame time of the first iteration after playback started includes the pause before
+	bool play_started;
+
+	// multi-view: grid_count medias from the current one on are shown side by side and
+	// played against grid_clock, 0 while a single media is shown
+	int grid_count;
+	double grid_clock;
+
+	struct compare compare;
+
+	struct slideshow slideshow;
+
+	bool show_perf;
+	double frame_start;
+
+	// character that opened the prompt, 0 while it is closed
+	char prompt;
+	char prompt_text[PROMPT_MAX];
+	int prompt_len;
+	char query[PROMPT_MAX];
+
+	bool show_outline;
+	int outline_selected;
+	int outline_first;
+
+	// the timeline is being dragged, the seek happens on release
+	bool scrubbing;
+
+	bool startup_profile;
+	bool startup_done;
+	double startup_start;
 };
 
+static void startup_mark(struct state *state, const char *stage) {
+	if (state->startup_profile && !state->startup_done) {
+		fprintf(stderr, "startup: %-12s %8.2f ms\n", stage, 1000 * (perf_now() - state->startup_start));
+	}
+}
+
+static void *load_font_thread(void *arg) {
+	struct font_loader *loader = arg;
+
+	int size = 0;
+	unsigned char *data = LoadFileData(FONT_PATH, &size);
+	if (data != NULL) {
+		Font font = {.baseSize = FONT_SIZE, .glyphCount = FONT_GLYPHS, .glyphPadding = FONT_PADDING};
+		font.glyphs = LoadFontData(data, size, FONT_SIZE, NULL, FONT_GLYPHS, FONT_DEFAULT);
+		if (font.glyphs != NULL) {
+			loader->atlas = GenImageFontAtlas(font.glyphs, &font.recs, FONT_GLYPHS, FONT_SIZE, FONT_PADDING, 0);
+			loader->font = font;
+		}
+		UnloadFileData(data);
+	}
+
+	atomic_store(&loader->done, true);
+	glfwPostEmptyEvent();
+	return NULL;
+}
+
+// the default font is used until the real one is rasterized
+static void start_font_loading(struct state *state) {
+	state->font = GetFontDefault();
+	if (pthread_create(&state->font_loader.thread, NULL, load_font_thread, &state->font_loader) != 0) {
+		state->font_loaded = true;
+	}
+}
+
+static void poll_font_loading(struct state *state) {
+	struct font_loader *loader = &state->font_loader;
+	if (state->font_loaded || !atomic_load(&loader->done)) {
+		return;
+	}
+
+	pthread_join(loader->thread, NULL);
+	state->font_loaded = true;
+	if (loader->font.glyphs == NULL) {
+		return;
+	}
+
+	loader->font.texture = LoadTextureFromImage(loader->atlas);
+	UnloadImage(loader->atlas);
+	SetTextureFilter(loader->font.texture, TEXTURE_FILTER_TRILINEAR);
+	state->font = loader->font;
+	startup_mark(state, "font");
+}
+
+static struct module *get_module(struct state *state, int index) {
+	if (!state->modules_ready[index]) {
+		trace_begin("module init");
+		state->modules[index] = module_inits[index]();
+		state->modules_ready[index] = true;
+		trace_end("module init");
+	}
+	return &state->modules[index];
+}
+
+// the module that will most likely take the file, so that the others are not initialized for it
+static int guess_module(const char *path) {
+	// streams have no extension, but can only be read once, so their first bytes decide
+	if (stream_is_stream(path)) {
+		struct stream *stream = stream_get(path);
+		return stream != NULL && stream_image_type(stream) != NULL ? MOD_INDEX_IMAGE : MOD_INDEX_VIDEO;
+	}
+	if (IsFileExtension(path, DOCUMENT_EXTENSIONS)) {
+		return MOD_INDEX_PDF;
+	}
+	if (IsFileExtension(path, VIDEO_EXTENSIONS)) {
+		return MOD_INDEX_VIDEO;
+	}
+	return MOD_INDEX_IMAGE;
+}
+
+static struct media *grid_media(struct state *state, int i) {
+	return &state->medias[(state->current_media + i) % state->n_medias];
+}
+
 static void stop_video(struct state *state) {
 	if (!state->video_running) {
 		return;
 	}
 
 	state->video_running = false;
+	for (int i = 0; i < state->grid_count; i++) {
+		struct media *media = grid_media(state, i);
+		if (media->sync != NULL) {
+			media->sync(media, -1);
+		}
+	}
 	EnableEventWaiting();
 }
 
-static void start_video(struct state *state) {
+static double playback_fps(struct state *state) {
+	double fps = video_get_fps(&state->medias[state->current_media]);
+	return fps > 0 ? fps : PLAY_FALLBACK_FPS;
+}
+
+static void start_video(struct state *state, int direction) {
+	state->play_direction = direction;
 	if (state->video_running) {
 		return;
 	}
 
+	// SetTargetFPS(0) would not limit the loop at all, animations slower than 1 fps run it at
+	// 1 fps and step only once their frame is due
 	state->video_running = true;
+	state->play_time = 0;
+	state->play_started = true;
 	DisableEventWaiting();
-	SetTargetFPS(video_get_fps(&state->medias[state->current_media]));
+	SetTargetFPS(state->grid_count > 0 ? GRID_FPS : fmax(1, round(playback_fps(state))));
+}
+
+static bool play_frame_due(struct state *state) {
+	double fps = playback_fps(state);
+	if (fps >= 1) {
+		return true;
+	}
+
+	state->play_time += GetFrameTime();
+	if (state->play_time < 1 / fps) {
+		return false;
+	}
+	state->play_time -= 1 / fps;
+	return true;
+}
+
+static void advise_file(const char *path, int advice) {
+	// opening the reading end of a fifo would let its writer start, or fail once it is closed again
+	if (stream_is_stream(path)) {
+		return;
+	}
+	if (archive_is_member(path)) {
+		if (advice == POSIX_FADV_WILLNEED) {
+			archive_prefetch(path);
+		}
+		return;
+	}
+
+	int fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		return;
+	}
+
+	// DONTNEED drops the same range, the rest of a watched video may still be wanted
+	off_t len = IsFileExtension(path, VIDEO_EXTENSIONS) ? PREFETCH_VIDEO_BYTES : 0;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		posix_fadvise(fd, 0, len, advice);
+	}
+	close(fd);
+}
+
+static int media_distance(struct state *state, int a, int b) {
+	int d = abs(a - b);
+	return d < state->n_medias - d ? d : state->n_medias - d;
+}
+
+// the files cached around the current one are reloaded when they change, documents cached
+// further away notice a change by its time when they are opened again
+static void watch_neighbours(struct state *state) {
+	int n = state->n_medias < 2 * PREFETCH_KEEP + 1 ? state->n_medias : 2 * PREFETCH_KEEP + 1;
+	const char *paths[2 * PREFETCH_KEEP + 1];
+	for (int d = 0; d < n; d++) {
+		// 0, 1, -1, 2, -2, ...
+		int offset = d % 2 == 1 ? (d + 1) / 2 : -d / 2;
+		int i = ((state->current_media + offset) % state->n_medias + state->n_medias) % state->n_medias;
+		paths[d] = state->media_paths[i];
+	}
+	watch_set(paths, n);
+}
+
+// posix_fadvise only schedules the reads, so the next files are read by the
+// kernel in the background while the current one is shown
+static void prefetch_neighbours(struct state *state) {
+	int current = state->current_media;
+	for (int d = -1; d <= PREFETCH_AHEAD; d++) {
+		int i = ((current + d) % state->n_medias + state->n_medias) % state->n_medias;
+		if (d != 0 && !state->media_advised[i]) {
+			advise_file(state->media_paths[i], POSIX_FADV_WILLNEED);
+			state->media_advised[i] = true;
+		}
+	}
+
+	for (int i = 0; i < state->n_medias; i++) {
+		if (state->media_advised[i] && media_distance(state, i, current) > PREFETCH_KEEP) {
+			advise_file(state->media_paths[i], POSIX_FADV_DONTNEED);
+			state->media_advised[i] = false;
+		}
+	}
+	watch_neighbours(state);
+}
+
+// the current media stays open
+static void close_grid(struct state *state) {
+	stop_video(state);
+	for (int i = 1; i < state->grid_count; i++) {
+		struct media *media = grid_media(state, i);
+		if (media->close != NULL) {
+			media->close(media);
+		}
+	}
+	state->grid_count = 0;
+}
+
+// drops the slide opened ahead and the one fading out, the current one is shown for a whole
+// interval again
+static void slideshow_reset(struct state *state) {
+	struct slideshow *show = &state->slideshow;
+	if (!show->running) {
+		return;
+	}
+
+	if (show->decoding) {
+		pthread_join(show->decoder, NULL);
+		show->decoding = false;
+		if (show->decode_ok) {
+			UnloadImage(show->image);
+		}
+	}
+	int open[] = {show->next_ready ? show->next : -1, show->previous};
+	for (int i = 0; i < 2; i++) {
+		if (open[i] < 0 || open[i] == state->current_media) {
+			continue;
+		}
+		struct media *media = &state->medias[open[i]];
+		if (media->close != NULL) {
+			media->close(media);
+		}
+	}
+	if (show->previous >= 0 && !state->video_running) {
+		EnableEventWaiting();
+	}
+
+	show->next = -1;
+	show->next_ready = false;
+	show->previous = -1;
+	show->deadline = perf_now() + show->interval;
+}
+
+static void close_current_media(struct state *state) {
+	slideshow_reset(state);
+	close_grid(state);
+	compare_close(&state->compare);
+	struct media *media = &state->medias[state->current_media];
+	if (media->close != NULL) {
+		media->close(media);
+	}
+}
+
+// returns the module that opened the media, -1 if none could
+static int open_media(struct state *state, int index) {
+	const char *mediapath = state->media_paths[index];
+	struct media *media = &state->medias[index];
+	trace_begin("open");
+	int guess = guess_module(mediapath);
+	for (int n = -1; n < N_MODULES; n++) {
+		int i = n < 0 ? guess : n;
+		if (n == guess) {
+			continue;
+		}
+		if (get_module(state, i)->open(media, mediapath) == true) {
+			trace_end("open");
+			return i;
+		}
+	}
+	trace_end("open");
+
+	*media = (struct media){0};
+	return -1;
 }
 
 static void load_current_media(struct state *state) {
-	const char *mediapath = state->media_paths[state->current_media];
+	prefetch_neighbours(state);
+
+	int module = open_media(state, state->current_media);
 	struct media *media = &state->medias[state->current_media];
-	for (int i = 0; i < N_MODULES; i++) {
-		if (state->modules[i].open(media, mediapath) == true) {
-			state->is_video = i == MOD_INDEX_VIDEO;
-			stop_video(state);
+	state->current_module = module;
+	state->is_video = module == MOD_INDEX_VIDEO;
+	stop_video(state);
+	if (state->is_video && video_is_animation(media)) {
+		start_video(state, 1);
+	}
+}
+
+// the current media and the ones after it, each video decoding on its own thread
+static void open_grid(struct state *state) {
+	int count = state->n_medias < GRID_MAX ? state->n_medias : GRID_MAX;
+	if (count < 2) {
+		return;
+	}
+
+	stop_video(state);
+	compare_close(&state->compare);
+	slideshow_reset(state);
+	for (int i = 1; i < count; i++) {
+		open_media(state, (state->current_media + i) % state->n_medias);
+	}
+	state->grid_count = count;
+	state->grid_clock = 0;
+	state->camera = (Camera2D){0};
+	state->camera.zoom = 1;
+}
+
+// the current image and the ones after it, all decoded at once
+static void open_compare(struct state *state, int count) {
+	if (count > state->n_medias) {
+		count = state->n_medias;
+	}
+
+	const char *paths[COMPARE_MAX];
+	for (int i = 0; i < count; i++) {
+		paths[i] = state->media_paths[(state->current_media + i) % state->n_medias];
+	}
+	close_grid(state);
+	trace_begin("compare");
+	bool opened = compare_open(&state->compare, paths, count);
+	trace_end("compare");
+	if (opened) {
+		state->camera = (Camera2D){0};
+		state->camera.zoom = 1;
+	}
+}
+
+// a multi-view or comparison replaces the current media on screen
+static bool multi_view(struct state *state) {
+	return state->grid_count > 0 || state->compare.count > 0;
+}
+
+// every video shows the frame due at the shared clock, the uploads of all of them
+// happen here once per drawn frame
+static void play_grid(struct state *state) {
+	state->grid_clock += GetFrameTime();
+	for (int i = 0; i < state->grid_count; i++) {
+		struct media *media = grid_media(state, i);
+		if (media->sync != NULL) {
+			media->sync(media, state->grid_clock);
+		}
+	}
+}
+
+// steps every media of the multi-view alike
+static void set_index_all(struct state *state, int index_mode, int amount) {
+	int count = state->grid_count > 0 ? state->grid_count : 1;
+	for (int i = 0; i < count; i++) {
+		struct media *media = grid_media(state, i);
+		if (media->set_index != NULL) {
+			media->set_index(media, index_mode, amount);
+		}
+	}
+}
+
+static void *slideshow_timer(void *arg) {
+	struct slideshow *show = arg;
+	pthread_mutex_lock(&show->lock);
+	while (!show->timer_stop) {
+		if (show->wake_at == 0) {
+			pthread_cond_wait(&show->cond, &show->lock);
+			continue;
+		}
+
+		time_t sec = show->wake_at;
+		struct timespec at = {.tv_sec = sec, .tv_nsec = (show->wake_at - sec) * 1e9};
+		if (pthread_cond_timedwait(&show->cond, &show->lock, &at) == ETIMEDOUT) {
+			show->wake_at = 0;
+			glfwPostEmptyEvent();
+		}
+	}
+	pthread_mutex_unlock(&show->lock);
+	return NULL;
+}
+
+static bool slideshow_timer_start(struct slideshow *show) {
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&show->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_mutex_init(&show->lock, NULL);
+	show->wake_at = 0;
+	show->timer_stop = false;
+	show->timer_started = pthread_create(&show->timer, NULL, slideshow_timer, show) == 0;
+	if (!show->timer_started) {
+		pthread_cond_destroy(&show->cond);
+		pthread_mutex_destroy(&show->lock);
+	}
+	return show->timer_started;
+}
+
+static void slideshow_timer_stop(struct slideshow *show) {
+	if (!show->timer_started) {
+		return;
+	}
+
+	pthread_mutex_lock(&show->lock);
+	show->timer_stop = true;
+	pthread_cond_signal(&show->cond);
+	pthread_mutex_unlock(&show->lock);
+	pthread_join(show->timer, NULL);
+	pthread_cond_destroy(&show->cond);
+	pthread_mutex_destroy(&show->lock);
+	show->timer_started = false;
+}
+
+// time is from perf_now, 0 wakes nobody
+static void slideshow_wake_at(struct slideshow *show, double time) {
+	if (!show->timer_started) {
+		return;
+	}
+
+	pthread_mutex_lock(&show->lock);
+	if (show->wake_at != time) {
+		show->wake_at = time;
+		pthread_cond_signal(&show->cond);
+	}
+	pthread_mutex_unlock(&show->lock);
+}
+
+static void *slideshow_decode_thread(void *arg) {
+	struct slideshow *show = arg;
+	show->decode_ok = image_decode(show->path, &show->image);
+	atomic_store(&show->decoded, true);
+	glfwPostEmptyEvent();
+	return NULL;
+}
+
+// images only need their upload left on the main thread, other media are opened right away,
+// which is still most of an interval before they are due
+static void slideshow_preload(struct state *state) {
+	struct slideshow *show = &state->slideshow;
+	show->next = (state->current_media + 1) % state->n_medias;
+	show->path = state->media_paths[show->next];
+	if (guess_module(show->path) == MOD_INDEX_IMAGE) {
+		atomic_store(&show->decoded, false);
+		show->decoding = pthread_create(&show->decoder, NULL, slideshow_decode_thread, show) == 0;
+		if (show->decoding) {
 			return;
 		}
 	}
 
-	state->is_video = false;
+	trace_begin("preload");
+	show->next_module = open_media(state, show->next);
+	show->next_ready = true;
+	trace_end("preload");
+}
+
+static void slideshow_poll_decode(struct state *state) {
+	struct slideshow *show = &state->slideshow;
+	if (!show->decoding || !atomic_load(&show->decoded)) {
+		return;
+	}
+
+	pthread_join(show->decoder, NULL);
+	show->decoding = false;
+	trace_begin("preload");
+	if (show->decode_ok) {
+		image_open_decoded(&state->medias[show->next], show->image);
+		show->next_module = MOD_INDEX_IMAGE;
+	} else {
+		// e.g. an animated image, which the video module plays
+		show->next_module = open_media(state, show->next);
+	}
+	show->next_ready = true;
+	trace_end("preload");
+}
+
+static double slideshow_fade(struct slideshow *show) {
+	return fmin(SLIDESHOW_FADE, show->interval / 4);
+}
+
+// opacity of the current slide while it fades in, 1 once it is shown alone
+static float slideshow_alpha(struct state *state) {
+	struct slideshow *show = &state->slideshow;
+	if (!show->running || show->previous < 0) {
+		return 1;
+	}
+	return Clamp((perf_now() - show->fade_start) / slideshow_fade(show), 0, 1);
+}
+
+// only swaps in the slide opened ahead, the previous one is drawn until the fade is over
+static void slideshow_advance(struct state *state, double now) {
+	struct slideshow *show = &state->slideshow;
+	double late = now - show->deadline;
+	if (late > SLIDESHOW_LATE) {
+		perf_count(PERF_MISSED_SLIDES, 1);
+		fprintf(stderr, "slideshow: %s shown %.1f ms after its deadline\n", show->path, 1000 * late);
+	}
+
 	stop_video(state);
-	*media = (struct media){0};
+	show->previous = state->current_media;
+	show->fade_start = now;
+	state->current_media = show->next;
+	state->current_module = show->next_module;
+	state->is_video = show->next_module == MOD_INDEX_VIDEO;
+	state->camera = (Camera2D){0};
+	state->camera.zoom = 1;
+	show->next = -1;
+	show->next_ready = false;
+	// a late slide is still shown for a whole interval instead of catching up
+	show->deadline = late > SLIDESHOW_LATE ? now + show->interval : show->deadline + show->interval;
+	prefetch_neighbours(state);
+
+	if (state->is_video && video_is_animation(&state->medias[state->current_media])) {
+		start_video(state, 1);
+	} else {
+		DisableEventWaiting();
+		SetTargetFPS(SLIDESHOW_FPS);
+	}
+}
+
+static void run_slideshow(struct state *state) {
+	struct slideshow *show = &state->slideshow;
+	if (!show->running) {
+		return;
+	}
+
+	// the multi-view and comparisons pause it, as does a list without a next slide
+	double now = perf_now();
+	if (multi_view(state) || state->n_medias < 2) {
+		show->deadline = now + show->interval;
+		return;
+	}
+
+	if (show->previous >= 0 && now - show->fade_start >= slideshow_fade(show)) {
+		struct media *previous = &state->medias[show->previous];
+		if (previous->close != NULL) {
+			previous->close(previous);
+		}
+		show->previous = -1;
+		if (!state->video_running) {
+			EnableEventWaiting();
+		}
+	}
+
+	if (show->previous < 0 && show->next < 0) {
+		slideshow_preload(state);
+	}
+	slideshow_poll_decode(state);
+	if (show->next_ready && now >= show->deadline) {
+		trace_begin("slide");
+		slideshow_advance(state, now);
+		trace_end("slide");
+	}
+	slideshow_wake_at(show, show->deadline > now ? show->deadline : 0);
+}
+
+static void toggle_slideshow(struct state *state) {
+	struct slideshow *show = &state->slideshow;
+	if (show->running) {
+		slideshow_reset(state);
+		show->running = false;
+		slideshow_timer_stop(show);
+		return;
+	}
+	if (state->n_medias < 2) {
+		return;
+	}
+	// without the timer the main loop would sleep through the deadlines
+	if (!slideshow_timer_start(show)) {
+		fprintf(stderr, "slideshow: cannot start its timer\n");
+		return;
+	}
+
+	if (show->interval <= 0) {
+		show->interval = SLIDESHOW_INTERVAL;
+	}
+	show->running = true;
+	show->deadline = perf_now() + show->interval;
 }
 
 static void render_text(struct state *state) {
@@ -76,27 +774,369 @@ static void render_text(struct state *state) {
 	struct media *media = &state->medias[current];
 	const char *path = state->media_paths[current];
 	const char *text = TextFormat("%d/%d: %s %s", current + 1, state->n_medias, path, media->text(media));
+	if (state->compare.count > 0) {
+		text = compare_text(&state->compare);
+	}
 	DrawRectangleV((Vector2){0, 0}, MeasureTextEx(state->font, text, 20, 0), BLACK);
 	DrawTextEx(state->font, text, (Vector2){0, 0}, 20, 0, WHITE);
 }
 
+static void render_perf(struct state *state) {
+	if (!state->show_perf) {
+		return;
+	}
+
+	const char *text = perf_text();
+	Vector2 size = MeasureTextEx(state->font, text, 20, 0);
+	Vector2 pos = {0, GetScreenHeight() - size.y};
+	DrawRectangleV(pos, size, BLACK);
+	DrawTextEx(state->font, text, pos, 20, 0, WHITE);
+}
+
+static void render_prompt(struct state *state) {
+	if (state->prompt == 0) {
+		return;
+	}
+
+	const char *label = state->prompt == 'g' ? "go to: " : "/";
+	const char *text = TextFormat("%s%s_", label, state->prompt_text);
+	Vector2 pos = {0, state->zoom ? 0 : 24};
+	DrawRectangleV(pos, MeasureTextEx(state->font, text, 20, 0), BLACK);
+	DrawTextEx(state->font, text, pos, 20, 0, WHITE);
+}
+
+static int outline_rows(void) {
+	return (GetScreenHeight() - OUTLINE_TOP) / OUTLINE_ROW;
+}
+
+static void render_outline(struct state *state) {
+	struct media *media = &state->medias[state->current_media];
+	if (!state->show_outline || media->outline == NULL) {
+		return;
+	}
+
+	const struct outline_entry *entries;
+	int n = media->outline(media, &entries);
+
+	int h = GetScreenHeight();
+	DrawRectangle(0, OUTLINE_TOP, OUTLINE_WIDTH, h - OUTLINE_TOP, Fade(BLACK, 0.85));
+	BeginScissorMode(0, OUTLINE_TOP, OUTLINE_WIDTH, h - OUTLINE_TOP);
+	for (int i = state->outline_first; i < n && i < state->outline_first + outline_rows(); i++) {
+		Vector2 pos = {8 + 16 * entries[i].level, OUTLINE_TOP + (i - state->outline_first) * OUTLINE_ROW};
+		if (i == state->outline_selected) {
+			DrawRectangle(0, pos.y, OUTLINE_WIDTH, OUTLINE_ROW, DARKGRAY);
+		}
+		DrawTextEx(state->font, TextFormat("%s  %d", entries[i].title, entries[i].index + 1), pos, 20, 0, WHITE);
+	}
+	EndScissorMode();
+}
+
+static bool timeline_hovered(struct state *state) {
+	struct media *media = &state->medias[state->current_media];
+	if (media->progress == NULL || state->zoom || state->show_outline || multi_view(state)) {
+		return false;
+	}
+	return state->scrubbing || GetMousePosition().y >= GetScreenHeight() - TIMELINE_HOVER;
+}
+
+static float timeline_position(void) {
+	return Clamp(GetMousePosition().x / GetScreenWidth(), 0, 1);
+}
+
+// dragging only shows previews, seeking to the position where the mouse is released
+static void read_timeline(struct state *state) {
+	struct media *media = &state->medias[state->current_media];
+	if (media->progress == NULL) {
+		state->scrubbing = false;
+		return;
+	}
+
+	if (timeline_hovered(state) && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+		state->scrubbing = true;
+	} else if (state->scrubbing && IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) {
+		state->scrubbing = false;
+		int count;
+		media->progress(media, &count);
+		media->set_index(media, INDEX_EXACT, timeline_position() * count);
+	}
+}
+
+static void render_timeline(struct state *state) {
+	struct media *media = &state->medias[state->current_media];
+	if (media->progress == NULL || state->zoom || multi_view(state)) {
+		return;
+	}
+
+	int count;
+	float progress = media->progress(media, &count);
+	int w = GetScreenWidth();
+	int h = GetScreenHeight();
+	bool hovered = timeline_hovered(state);
+	int height = hovered ? 2 * TIMELINE_HEIGHT : TIMELINE_HEIGHT;
+	DrawRectangle(0, h - height, w, height, Fade(BLACK, 0.6));
+	DrawRectangle(0, h - height, w * progress, height, LIGHTGRAY);
+	if (!hovered) {
+		return;
+	}
+
+	float position = timeline_position();
+	DrawRectangle(w * position - 1, h - height, 2, height, WHITE);
+	Texture2D preview = media->preview != NULL ? media->preview(media, position) : (Texture2D){0};
+	if (preview.id != 0) {
+		Vector2 pos = {Clamp(w * position - preview.width / 2.0, 0, w - preview.width), h - height - preview.height - 4};
+		DrawTextureV(preview, pos, WHITE);
+	}
+}
+
+// counts the frames a running video missed since the last loop iteration
+// the multi-view counts the frames it skips itself
+static void count_dropped_frames(struct state *state) {
+	if (!state->video_running || state->grid_count > 0) {
+		return;
+	}
+	if (state->play_started) {
+		state->play_started = false;
+		return;
+	}
+
+	int missed = GetFrameTime() * playback_fps(state) - 0.5;
+	if (missed > 0) {
+		perf_count(PERF_DROPPED_FRAMES, missed);
+	}
+}
+
+// equal cells, each media fitted into its own
+static void render_grid(struct state *state) {
+	int n = state->grid_count;
+	int cols = ceilf(sqrtf(n));
+	int rows = (n + cols - 1) / cols;
+	float cell_w = GetScreenWidth() / (float) cols;
+	float cell_h = GetScreenHeight() / (float) rows;
+	for (int i = 0; i < n; i++) {
+		struct media *media = grid_media(state, i);
+		Texture2D t = media->texture;
+		if (t.id == 0) {
+			continue;
+		}
+
+		float scale = fminf(cell_w / t.width, cell_h / t.height);
+		Vector2 pos = {
+			(i % cols) * cell_w + (cell_w - t.width * scale) / 2,
+			(i / cols) * cell_h + (cell_h - t.height * scale) / 2,
+		};
+		DrawTextureEx(t, pos, 0, scale, WHITE);
+		if (media->set_view != NULL) {
+			float shown = scale * state->camera.zoom;
+			media->set_view(media, t.width * shown, t.height * shown);
+		}
+	}
+}
+
+// returns the scale the texture is drawn at
+static float draw_fitted(Texture2D t, Color tint) {
+	int w = GetScreenWidth();
+	int h = GetScreenHeight();
+	float scale = fminf(w / (float) t.width, h / (float) t.height);
+	Vector2 pos = {(w - t.width * scale) / 2, (h - t.height * scale) / 2};
+	DrawTextureEx(t, pos, 0, scale, tint);
+	return scale;
+}
+
 static void redraw_current_media(struct state *state) {
 	struct media *media = &state->medias[state->current_media];
 	Texture2D t = media->texture;
 
+	trace_begin("draw");
 	BeginDrawing();
 	ClearBackground(BLACK);
 
 	BeginMode2D(state->camera);
-	int w = GetScreenWidth();
-	int h = GetScreenHeight();
-	float scale = fminf(w / (float) t.width, h / (float) t.height);
-	Vector2 pos = {(w - t.width * scale) / 2, (h - t.height * scale) / 2};
-	DrawTextureEx(t, pos, 0, scale, WHITE);
+	if (state->grid_count > 0) {
+		render_grid(state);
+	} else if (state->compare.count > 0) {
+		compare_draw(&state->compare);
+	} else if (media->draw != NULL) {
+		media->draw(media, &state->camera);
+	} else {
+		// both slides are added onto the black background, so the crossfade does not darken
+		float alpha = slideshow_alpha(state);
+		if (alpha < 1) {
+			struct media *previous = &state->medias[state->slideshow.previous];
+			BeginBlendMode(BLEND_ADDITIVE);
+			if (previous->texture.id > 0) {
+				draw_fitted(previous->texture, ColorAlpha(WHITE, 1 - alpha));
+			}
+		}
+		float scale = draw_fitted(t, ColorAlpha(WHITE, alpha));
+		if (alpha < 1) {
+			EndBlendMode();
+		}
+		if (media->set_view != NULL && t.id > 0) {
+			float shown = scale * state->camera.zoom;
+			media->set_view(media, t.width * shown, t.height * shown);
+		}
+	}
 	EndMode2D();
 
 	render_text(state);
+	render_timeline(state);
+	render_outline(state);
+	render_prompt(state);
+	render_perf(state);
+	perf_record(PERF_FRAME, state->frame_start);
 	EndDrawing();
+	trace_end("draw");
+}
+
+static void *reload_thread(void *arg) {
+	struct reloader *reloader = arg;
+	reloader->ok = image_decode(reloader->path, &reloader->image);
+	atomic_store(&reloader->done, true);
+	glfwPostEmptyEvent();
+	return NULL;
+}
+
+static void start_reload(struct state *state) {
+	struct reloader *reloader = &state->reloader;
+	if (reloader->running) {
+		reloader->again = true;
+		return;
+	}
+
+	*reloader = (struct reloader){
+		.media = state->current_media,
+		.path = strdup(state->media_paths[state->current_media]),
+	};
+	reloader->running = pthread_create(&reloader->thread, NULL, reload_thread, reloader) == 0;
+	if (!reloader->running) {
+		free(reloader->path);
+	}
+}
+
+// swaps the decoded image in if it is still shown, cancel drops it either way
+static void finish_reload(struct state *state, bool cancel) {
+	struct reloader *reloader = &state->reloader;
+	if (!reloader->running || (!cancel && !atomic_load(&reloader->done))) {
+		return;
+	}
+
+	pthread_join(reloader->thread, NULL);
+	reloader->running = false;
+	free(reloader->path);
+	bool image = !cancel && state->current_module == MOD_INDEX_IMAGE && !multi_view(state);
+	if (reloader->ok && image && reloader->media == state->current_media) {
+		// the image module has no state besides its texture, the camera stays where it was
+		struct media *media = &state->medias[state->current_media];
+		perf_unload_texture(media->texture);
+		media->texture = perf_load_texture(reloader->image);
+	}
+	if (reloader->ok) {
+		UnloadImage(reloader->image);
+	}
+	if (reloader->again && image) {
+		start_reload(state);
+	}
+}
+
+// documents and videos are opened again at the position they were shown at
+static void reopen_current_media(struct state *state) {
+	struct media *media = &state->medias[state->current_media];
+	int count = 0;
+	float position = media->progress != NULL ? media->progress(media, &count) : 0;
+	bool running = state->video_running && !video_is_animation(media);
+
+	close_current_media(state);
+	load_current_media(state);
+	media = &state->medias[state->current_media];
+	if (count > 0 && media->progress != NULL) {
+		media->set_index(media, INDEX_EXACT, position * count);
+	}
+	if (running) {
+		start_video(state, state->play_direction);
+	}
+}
+
+// a member changes with its archive
+static bool is_from_file(const char *mediapath, const char *path) {
+	size_t len = strlen(path);
+	return strncmp(mediapath, path, len) == 0 && (mediapath[len] == '\0' || strncmp(mediapath + len, ARCHIVE_SEPARATOR, strlen(ARCHIVE_SEPARATOR)) == 0);
+}
+
+// drops the cached versions of changed files and shows the new version of the current one;
+// medias shown side by side keep the version they were opened with
+static void reload_changed_files(struct state *state) {
+	int n;
+	char **paths = watch_poll(&n);
+	for (int i = 0; i < n; i++) {
+		if (archive_is_archive(paths[i])) {
+			archive_forget(paths[i]);
+		}
+
+		bool current = false;
+		for (int m = 0; m < state->n_medias; m++) {
+			if (!is_from_file(state->media_paths[m], paths[i])) {
+				continue;
+			}
+			for (int k = 0; k < N_MODULES; k++) {
+				if (state->modules_ready[k] && state->modules[k].forget != NULL) {
+					state->modules[k].forget(state->media_paths[m]);
+				}
+			}
+			current |= m == state->current_media;
+		}
+
+		if (current && !multi_view(state) && state->current_module == MOD_INDEX_IMAGE) {
+			start_reload(state);
+		} else if (current && !multi_view(state)) {
+			trace_begin("reload");
+			reopen_current_media(state);
+			trace_end("reload");
+		}
+		free(paths[i]);
+	}
+	free(paths);
+}
+
+// shows the paths another invocation forwarded to this server instead of the current list
+static void receive_media_list(struct state *state) {
+	int n;
+	char **paths = server_poll(&n);
+	if (paths == NULL) {
+		return;
+	}
+
+	stop_video(state);
+	finish_reload(state, true);
+	slideshow_reset(state);
+	state->grid_count = 0;
+	compare_close(&state->compare);
+	for (int i = 0; i < state->n_medias; i++) {
+		struct media *media = &state->medias[i];
+		if (media->close != NULL) {
+			media->close(media);
+		}
+	}
+	free(state->medias);
+	free(state->media_advised);
+	for (int i = 0; i < state->n_medias; i++) {
+		free((char *) state->media_paths[i]);
+	}
+	free(state->media_paths);
+
+	state->n_medias = archive_expand((const char **) paths, n, &state->media_paths);
+	for (int i = 0; i < n; i++) {
+		free(paths[i]);
+	}
+	free(paths);
+	state->medias = calloc(state->n_medias, sizeof(struct media));
+	state->media_advised = calloc(state->n_medias, sizeof(bool));
+	state->current_media = 0;
+	state->camera = (Camera2D){0};
+	state->camera.zoom = 1;
+
+	watch_clear();
+	load_current_media(state);
+	SetWindowFocused();
 }
 
 static int get_number(int key) {
@@ -115,46 +1155,276 @@ static int get_number(int key) {
 	}
 }
 
+// escape closes the prompt instead of the window while it is open
+static void open_prompt(struct state *state, char prompt) {
+	state->prompt = prompt;
+	state->prompt_len = 0;
+	state->prompt_text[0] = '\0';
+	SetExitKey(KEY_NULL);
+	while (GetCharPressed() != 0) {}
+	while (GetKeyPressed() != 0) {}
+}
+
+static void close_prompt(struct state *state) {
+	state->prompt = 0;
+	SetExitKey(KEY_ESCAPE);
+}
+
+// a page label of the media if it has one, otherwise the 1-based number, -1 if neither
+static int prompt_target(struct state *state) {
+	struct media *media = &state->medias[state->current_media];
+	if (media->find_label != NULL && state->prompt_len > 0) {
+		int index = media->find_label(media, state->prompt_text);
+		if (index >= 0) {
+			return index;
+		}
+	}
+
+	char *end;
+	long n = strtol(state->prompt_text, &end, 10);
+	return end != state->prompt_text && *end == '\0' && n > 0 ? n - 1 : -1;
+}
+
+static void submit_prompt(struct state *state) {
+	struct media *media = &state->medias[state->current_media];
+	if (state->prompt == 'g') {
+		int index = prompt_target(state);
+		if (index >= 0) {
+			media->set_index(media, INDEX_EXACT, index);
+		}
+	} else if (state->prompt == '/' && state->prompt_len > 0) {
+		strcpy(state->query, state->prompt_text);
+		if (media->search != NULL) {
+			media->search(media, state->query, 0);
+		}
+	}
+	close_prompt(state);
+}
+
+// edits the prompt line, returns KEY_NULL so that typed keys are not handled as bindings
+static int read_prompt(struct state *state) {
+	int c;
+	while ((c = GetCharPressed()) != 0) {
+		int len;
+		const char *utf8 = CodepointToUTF8(c, &len);
+		if (state->prompt_len + len < PROMPT_MAX) {
+			memcpy(state->prompt_text + state->prompt_len, utf8, len);
+			state->prompt_len += len;
+			state->prompt_text[state->prompt_len] = '\0';
+		}
+	}
+
+	// the typed page is rendered while the rest of it is typed
+	struct media *media = &state->medias[state->current_media];
+	if (state->prompt == 'g' && media->prefetch != NULL) {
+		media->prefetch(media, prompt_target(state));
+	}
+
+	int key;
+	while ((key = GetKeyPressed()) != 0) {
+		if (key == KEY_BACKSPACE && state->prompt_len > 0) {
+			// removes the whole utf-8 sequence of the last character
+			do {
+				state->prompt_len--;
+			} while (state->prompt_len > 0 && (state->prompt_text[state->prompt_len] & 0xc0) == 0x80);
+			state->prompt_text[state->prompt_len] = '\0';
+		} else if (key == KEY_ESCAPE) {
+			close_prompt(state);
+			break;
+		} else if (key == KEY_ENTER || key == KEY_KP_ENTER) {
+			submit_prompt(state);
+			break;
+		}
+	}
+	return KEY_NULL;
+}
+
+static void open_outline(struct state *state) {
+	struct media *media = &state->medias[state->current_media];
+	const struct outline_entry *entries;
+	if (media->outline == NULL || media->outline(media, &entries) == 0) {
+		return;
+	}
+
+	state->show_outline = true;
+	state->outline_selected = 0;
+	state->outline_first = 0;
+	SetExitKey(KEY_NULL);
+}
+
+static void close_outline(struct state *state) {
+	state->show_outline = false;
+	SetExitKey(KEY_ESCAPE);
+}
+
+// moves the selection of the outline panel by keys, wheel and hovering and prefetches
+// the selected entry, returns KEY_NULL so that keys are not handled as bindings
+static int read_outline(struct state *state) {
+	struct media *media = &state->medias[state->current_media];
+	// the media may have been replaced by the server
+	if (media->outline == NULL) {
+		close_outline(state);
+		return KEY_NULL;
+	}
+
+	const struct outline_entry *entries;
+	int n = media->outline(media, &entries);
+	int rows = outline_rows();
+	int selected = state->outline_selected;
+	bool jump = false;
+
+	Vector2 mouse = GetMousePosition();
+	int row = mouse.y < OUTLINE_TOP ? -1 : (mouse.y - OUTLINE_TOP) / OUTLINE_ROW;
+	bool hovered = mouse.x < OUTLINE_WIDTH && row >= 0 && state->outline_first + row < n;
+	if (hovered && (GetMouseDelta().x != 0 || GetMouseDelta().y != 0)) {
+		selected = state->outline_first + row;
+	}
+	if (hovered && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+		selected = state->outline_first + row;
+		jump = true;
+	}
+	selected -= 3 * GetMouseWheelMove();
+
+	int key;
+	while ((key = GetKeyPressed()) != 0) {
+		switch (key) {
+			case KEY_UP: selected--; break;
+			case KEY_DOWN: selected++; break;
+			case KEY_PAGE_UP: selected -= rows; break;
+			case KEY_PAGE_DOWN: selected += rows; break;
+			case KEY_HOME: selected = 0; break;
+			case KEY_END: selected = n - 1; break;
+			case KEY_ENTER:
+			case KEY_KP_ENTER: jump = true; break;
+			case KEY_ESCAPE:
+			case KEY_O: close_outline(state); return KEY_NULL;
+			default: break;
+		}
+	}
+
+	selected = selected < 0 ? 0 : selected >= n ? n - 1 : selected;
+	if (selected < state->outline_first) {
+		state->outline_first = selected;
+	} else if (selected >= state->outline_first + rows) {
+		state->outline_first = selected - rows + 1;
+	}
+	if (selected != state->outline_selected && media->prefetch != NULL) {
+		media->prefetch(media, entries[selected].index);
+	}
+	state->outline_selected = selected;
+
+	if (jump) {
+		close_outline(state);
+		state->camera = (Camera2D){0};
+		state->camera.zoom = 1;
+		media->set_index(media, INDEX_EXACT, entries[selected].index);
+	}
+	return KEY_NULL;
+}
+
+// the key that types '/' depends on the layout, so the prompt is opened by the character
+static int read_key(struct state *state) {
+	int c;
+	while ((c = GetCharPressed()) != 0) {
+		if (c == '/') {
+			open_prompt(state, '/');
+			return KEY_NULL;
+		}
+	}
+	return GetKeyPressed();
+}
+
+static void print_usage(const char *name) {
+	printf("Usage as zoom: %s --zoom <image>\n", name);
+	printf("Usage: %s [options] [images/pdfs/videos/archives...]\n", name);
+	printf("Usage as batch export: %s --export [export options] [files...], see %s --export\n", name, name);
+	printf("  - or a fifo as a file reads an image or video stream, e.g. curl ... | %s -\n", name);
+	printf("Options:\n");
+	printf("  --zoom: fullscreen without text overlay\n");
+	printf("  --trace <file>: write a chrome trace of the session to file on exit\n");
+	printf("  --server: keep running and show the files of later invocations\n");
+	printf("  --startup-profile: print the time to the window, first open and first frame to stderr\n");
+	printf("  --slideshow <seconds>: start a slideshow that shows every file for seconds\n");
+	printf("Mouse- / Keybinds:\n");
+	printf("  scrolling up: zooming in\n");
+	printf("  scrolling down: zooming out\n");
+	printf("  click and drag: move image around\n");
+	printf("  r: reset image and position to fit screen\n");
+	printf("  Arrow left/right: go to previous/next image\n");
+	printf("  Arrow up/down: go to previous/next pdf page/video frame\n");
+	printf("  Space: start video playback\n");
+	printf("  b: play video backwards\n");
+	printf("  m: toggle showing the following files side by side, videos play in sync\n");
+	printf("  x / shift+x: toggle comparing the image with the next one / next three\n");
+	printf("  t: while comparing, show each image in place in turn\n");
+	printf("  d: while comparing, toggle the difference of the first two images\n");
+	printf("  hovering the bottom of a video: preview, click or drag to seek\n");
+	printf("  p: toggle performance overlay\n");
+	printf("  s: toggle the slideshow, advancing every 5 seconds or the --slideshow interval\n");
+	printf("  /: search the text of a pdf, enter to search, escape to cancel\n");
+	printf("  n / shift+n: go to the next/previous page with a search hit\n");
+	printf("  o: toggle the outline of a pdf, enter or click to go to an entry\n");
+	printf("  v: toggle continuous scrolling through a pdf, ctrl+scrolling zooms\n");
+	printf("  g: go to a page label / page / video frame, enter to go, escape to cancel\n");
+}
+
 int main(int argc, const char **argv) {
-	if (argc < 2) {
-		printf("Usage as zoom: %s --zoom <image>\n", argv[0]);
-		printf("Usage: %s [images/pdfs...]\n", argv[0]);
-		printf("Mouse- / Keybinds:\n");
-		printf("  scrolling up: zooming in\n");
-		printf("  scrolling down: zooming out\n");
-		printf("  click and drag: move image around\n");
-		printf("  r: reset image and position to fit screen\n");
-		printf("  Arrow left/right: go to previous/next image\n");
-		printf("  Arrow up/down: go to previous/next pdf page/video frame\n");
-		printf("  Space: start video playback\n");
+	struct state state = {0};
+	state.zoom = false;
+	state.startup_start = perf_now();
+
+	// batch export runs without a window
+	if (argc > 1 && strcmp(argv[1], "--export") == 0) {
+		return export_main(argc - 2, argv + 2);
+	}
+
+	int argi = 1;
+	for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+		if (strcmp(argv[argi], "--zoom") == 0) {
+			state.zoom = true;
+		} else if (strcmp(argv[argi], "--server") == 0) {
+			state.server = true;
+		} else if (strcmp(argv[argi], "--startup-profile") == 0) {
+			state.startup_profile = true;
+		} else if (strcmp(argv[argi], "--trace") == 0 && argi + 1 < argc) {
+			trace_init(argv[++argi]);
+		} else if (strcmp(argv[argi], "--slideshow") == 0 && argi + 1 < argc && atof(argv[argi + 1]) > 0) {
+			state.slideshow.interval = atof(argv[++argi]);
+		} else {
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argi >= argc) {
+		print_usage(argv[0]);
 		return 1;
 	}
 
-	struct state state = {0};
+	// a running server shows the files instead, before any window is created; stdin and
+	// pipes can only be read by this process
+	bool streams = false;
+	for (int i = argi; i < argc; i++) {
+		streams |= stream_is_stream(argv[i]);
+	}
+	if (!state.zoom && !streams && server_forward(argv + argi, argc - argi)) {
+		return 0;
+	}
 
 	SetTraceLogLevel(LOG_NONE);
 	SetConfigFlags(FLAG_WINDOW_RESIZABLE);
 	InitWindow(0, 0, "imgview2");
-	state.font = LoadFont("/home/oskar/.local/share/fonts/NotoSansMonoNerd.ttf");
-	SetTextureFilter(state.font.texture, TEXTURE_FILTER_TRILINEAR);
-
-	state.modules[MOD_INDEX_IMAGE] = image_init();
-	state.modules[MOD_INDEX_PDF] = pdf_init();
-	state.modules[MOD_INDEX_VIDEO] = video_init();
-	state.modules[MOD_INDEX_FALLBACK] = fallback_init();
+	startup_mark(&state, "window");
+	start_font_loading(&state);
 
-	state.n_medias = argc - 1;
-	state.media_paths = argv + 1;
+	state.n_medias = archive_expand(argv + argi, argc - argi, &state.media_paths);
 
-	state.zoom = false;
-	if (strcmp(argv[1], "--zoom") == 0) {
-		state.zoom = true;
-		state.n_medias--;
-		state.media_paths++;
+	if (state.zoom) {
 		ToggleFullscreen();
 	}
 
 	state.medias = calloc(state.n_medias, sizeof(struct media));
+	state.media_advised = calloc(state.n_medias, sizeof(bool));
 	state.current_media = 0;
 
 	state.camera = (Camera2D){0};
@@ -163,17 +1433,48 @@ int main(int argc, const char **argv) {
 	stop_video(&state);
 
 	load_current_media(&state);
+	startup_mark(&state, "first open");
+
+	state.slideshow.next = -1;
+	state.slideshow.previous = -1;
+	if (state.slideshow.interval > 0) {
+		toggle_slideshow(&state);
+	}
+
+	if (state.server) {
+		state.server = server_start();
+	}
 
 	EnableEventWaiting();
 	while (!WindowShouldClose()) {
-		if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+		state.frame_start = perf_now();
+		count_dropped_frames(&state);
+		trace_begin("input");
+		poll_font_loading(&state);
+
+		if (state.server) {
+			receive_media_list(&state);
+		}
+		reload_changed_files(&state);
+		finish_reload(&state, false);
+		struct media *current = &state.medias[state.current_media];
+		if (current->poll != NULL && !multi_view(&state)) {
+			current->poll(current);
+		}
+
+		read_timeline(&state);
+		if (IsMouseButtonDown(MOUSE_BUTTON_LEFT) && !state.show_outline && !state.scrubbing) {
 			Vector2 delta = GetMouseDelta();
 			delta = Vector2Scale(delta, -1.0 / state.camera.zoom);
 			state.camera.target = Vector2Add(state.camera.target, delta);
 		}
 
+		// media that draw themselves scroll with the wheel and zoom with ctrl held
 		float wheel = GetMouseWheelMove();
-		if (wheel != 0) {
+		bool scrolls = state.medias[state.current_media].draw != NULL && !multi_view(&state) && !IsKeyDown(KEY_LEFT_CONTROL);
+		if (wheel != 0 && !state.show_outline && scrolls) {
+			state.camera.target.y -= wheel * SCROLL_STEP / state.camera.zoom;
+		} else if (wheel != 0 && !state.show_outline) {
 			Vector2 mouseWorldPos = GetScreenToWorld2D(GetMousePosition(), state.camera);
 			state.camera.offset = GetMousePosition();
 			state.camera.target = mouseWorldPos;
@@ -181,9 +1482,19 @@ int main(int argc, const char **argv) {
 			state.camera.zoom = Clamp(state.camera.zoom, 0.00001, 500000);
 		}
 
-		int key = GetKeyPressed();
+		int key;
+		if (state.prompt != 0) {
+			key = read_prompt(&state);
+		} else if (state.show_outline) {
+			key = read_outline(&state);
+		} else {
+			key = read_key(&state);
+		}
 		switch (key) {
-			case KEY_Q: goto loop_exit;
+			case KEY_Q: {
+				trace_end("input");
+				goto loop_exit;
+			}
 			case KEY_R: {
 				state.camera = (Camera2D){0};
 				state.camera.zoom = 1;
@@ -192,6 +1503,7 @@ int main(int argc, const char **argv) {
 			case KEY_RIGHT: {
 				state.camera = (Camera2D){0};
 				state.camera.zoom = 1;
+				close_current_media(&state);
 				state.current_media = (state.current_media + 1) % state.n_medias;
 				load_current_media(&state);
 				break;
@@ -199,6 +1511,7 @@ int main(int argc, const char **argv) {
 			case KEY_LEFT: {
 				state.camera = (Camera2D){0};
 				state.camera.zoom = 1;
+				close_current_media(&state);
 				state.current_media--;
 				if (state.current_media < 0) {
 					state.current_media = state.n_medias - 1;
@@ -210,8 +1523,67 @@ int main(int argc, const char **argv) {
 			case KEY_DOWN: {
 				int shift = IsKeyDown(KEY_LEFT_SHIFT) ? state.is_video ? 50 : 5 : 1;
 				int dir = key == KEY_UP ? -1 : 1;
+				set_index_all(&state, INDEX_RELATIVE, dir * shift);
+				break;
+			}
+			case KEY_X: {
+				if (state.compare.count > 0) {
+					compare_close(&state.compare);
+				} else {
+					open_compare(&state, IsKeyDown(KEY_LEFT_SHIFT) ? COMPARE_MAX : 2);
+				}
+				break;
+			}
+			case KEY_T: {
+				if (state.compare.count > 0) {
+					compare_flicker(&state.compare);
+				}
+				break;
+			}
+			case KEY_D: {
+				if (state.compare.count > 0) {
+					compare_toggle_diff(&state.compare);
+				}
+				break;
+			}
+			case KEY_M: {
+				if (state.grid_count > 0) {
+					close_grid(&state);
+				} else {
+					open_grid(&state);
+				}
+				break;
+			}
+			case KEY_P: {
+				state.show_perf = !state.show_perf;
+				break;
+			}
+			case KEY_S: {
+				toggle_slideshow(&state);
+				break;
+			}
+			case KEY_O: {
+				open_outline(&state);
+				break;
+			}
+			case KEY_V: {
 				struct media *media = &state.medias[state.current_media];
-				media->set_index(media, INDEX_RELATIVE, dir * shift);
+				if (media->toggle_continuous != NULL) {
+					state.camera = (Camera2D){0};
+					state.camera.zoom = 1;
+					media->toggle_continuous(media);
+				}
+				break;
+			}
+			case KEY_G: {
+				open_prompt(&state, 'g');
+				break;
+			}
+			case KEY_N: {
+				struct media *media = &state.medias[state.current_media];
+				if (state.query[0] != '\0' && media->search != NULL) {
+					media->search(media, state.query, IsKeyDown(KEY_LEFT_SHIFT) ? -1 : 1);
+				}
 				break;
 			}
 			case KEY_C: {
@@ -225,29 +1597,52 @@ int main(int argc, const char **argv) {
 					break;
 				}
 
-				struct media *media = &state.medias[state.current_media];
-				media->set_index(media, INDEX_ABSOLUTE, n);
+				set_index_all(&state, INDEX_ABSOLUTE, n);
 				break;
 			}
 		}
 
-		if (state.is_video && IsKeyPressed(KEY_SPACE)) {
+		bool playable = (state.is_video || state.grid_count > 0) && state.compare.count == 0;
+		if (playable && state.prompt == 0 && !state.show_outline && IsKeyPressed(KEY_SPACE)) {
 			if (state.video_running) {
 				stop_video(&state);
 			} else {
-				start_video(&state);
+				start_video(&state, 1);
 			}
 		}
+		if (state.is_video && !multi_view(&state) && state.prompt == 0 && !state.show_outline && IsKeyPressed(KEY_B)) {
+			if (state.video_running && state.play_direction < 0) {
+				stop_video(&state);
+			} else {
+				start_video(&state, -1);
+			}
+		}
+
+		trace_end("input");
 
-		if (state.video_running) {
+		run_slideshow(&state);
+		if (state.video_running && state.grid_count > 0) {
+			trace_begin("play");
+			play_grid(&state);
+			trace_end("play");
+		} else if (state.video_running && play_frame_due(&state)) {
 			struct media *media = &state.medias[state.current_media];
-			media->set_index(media, INDEX_RELATIVE, 1);
+			trace_begin("play");
+			media->set_index(media, INDEX_RELATIVE, state.play_direction);
+			trace_end("play");
 		}
 
 		redraw_current_media(&state);
+		if (!state.startup_done) {
+			startup_mark(&state, "first frame");
+			state.startup_done = true;
+		}
 	}
 
 loop_exit:
+	slideshow_reset(&state);
+	slideshow_timer_stop(&state.slideshow);
+	trace_write();
 	CloseWindow();
 	return 0;
 }
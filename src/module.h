@@ -5,16 +5,83 @@
 
 #define INDEX_RELATIVE 0
 #define INDEX_ABSOLUTE 1
+// amount is the page or frame number itself
+#define INDEX_EXACT 2
+
+// entry of a table of contents, index is used with INDEX_EXACT
+struct outline_entry {
+	const char *title;
+	int level;
+	int index;
+};
 
 struct media {
 	void (*set_index)(struct media *self, int index_mode, int amount);
 	const char* (*text)(struct media *self);
+	// releases everything the media holds, may be NULL to keep the media open
+	void (*close)(struct media *self);
+	// goes to the first hit of query from the current position (direction 0) or to the
+	// next (1) / previous (-1) one, may be NULL when the media has no text
+	void (*search)(struct media *self, const char *query, int direction);
+	// table of contents, returns the number of entries, may be NULL
+	int (*outline)(struct media *self, const struct outline_entry **entries);
+	// prepares index (INDEX_EXACT) in the background so that going there is fast, may be NULL
+	void (*prefetch)(struct media *self, int index);
+	// the INDEX_EXACT index of a page label like "iv", -1 if it is unknown, may be NULL
+	int (*find_label)(struct media *self, const char *label);
+	// switches between showing one page and scrolling through all of them, may be NULL
+	void (*toggle_continuous)(struct media *self);
+	// draws the media in the world of camera instead of the texture, and may move the
+	// camera, e.g. to a page that was jumped to; NULL to draw the texture fitted to the screen
+	void (*draw)(struct media *self, Camera2D *camera);
+	// position of the shown frame from 0 to 1, count is set to the number of INDEX_EXACT
+	// indices, may be NULL for media without a timeline
+	float (*progress)(struct media *self, int *count);
+	// small preview of the media at position 0 to 1, id 0 while there is none, may be NULL
+	Texture2D (*preview)(struct media *self, float position);
+	// size in screen pixels the whole media is drawn at, so that it can be decoded at a
+	// matching resolution, may be NULL
+	void (*set_view)(struct media *self, int width, int height);
+	// shows the frame due clock seconds after synced playback started, decoding ahead on
+	// a thread until it is called with a negative clock, may be NULL for still media
+	void (*sync)(struct media *self, double clock);
+	// called once per loop iteration before the media is drawn, for work that finishes in the
+	// background and changes what is shown, may be NULL
+	void (*poll)(struct media *self);
 	void *userdata;
 	Texture2D texture;
 };
 
 struct module {
 	bool (*open)(struct media *media, const char *file);
+	// drops what is cached of file after it changed on disk, so that the next open reads it
+	// again, may be NULL
+	void (*forget)(const char *file);
 };
 
-int video_get_fps(struct media *media);
+// part of the glfw inside libraylib.a, wakes the main loop while it waits for
+// events, e.g. when a background thread finished work that should be shown
+void glfwPostEmptyEvent(void);
+
+// extensions the modules are tried in order of, other files go to the image module first;
+// the pdf module opens every document format mupdf has a handler for
+#define DOCUMENT_EXTENSIONS ".pdf;.epub;.xps;.fb2;.mobi"
+#define VIDEO_EXTENSIONS ".mp4;.mkv;.webm;.avi;.mov;.webp"
+
+// decodes a still image to rgba or another cpu side format without uploading it
+bool image_decode(const char *path, Image *image);
+// opens media as the image module would from an image_decode result, which it takes over
+void image_open_decoded(struct media *media, Image image);
+
+// --export renders without a window and from several threads at once
+int pdf_export_count(const char *path);
+// page from 0, at dpi pixels per inch
+bool pdf_export_page(const char *path, int page, float dpi, Image *image);
+// closes the document the calling thread exported from last
+void pdf_export_done(void);
+// the frame shown at seconds, or frame if it is not negative
+bool video_export_frame(const char *path, double seconds, int frame, Image *image);
+
+// frames per second of the stream, 0 if it is unknown
+double video_get_fps(struct media *media);
+bool video_is_animation(struct media *media);
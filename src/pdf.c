@@ -1,84 +1,1059 @@
+#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <mupdf/fitz.h>
 
+#include "archive.h"
 #include "module.h"
+#include "perf.h"
+#include "pixel.h"
+
+// documents kept open after their media is closed, so switching back is instant
+#define PDF_CACHED 8
+// size of the shared resource store (fonts, glyphs, images) in MiB
+#define PDF_STORE_ENV "IMGVIEW_PDF_STORE_MB"
+// highlighted search hits per page
+#define PDF_MAX_HITS 256
+// longer words are cut off, in bytes
+#define PDF_WORD_MAX 64
+#define PDF_QUERY_WORDS 16
+// the index thread wakes the main loop this often to update the progress
+#define PDF_INDEX_WAKE 32
+// pages are rendered this wide, so that zooming in stays sharp
+#define PDF_RENDER_WIDTH 5000.0
+// display lists kept per document, they are small compared to rasters
+#define PDF_LISTS 32
+// rasters rendered ahead by the worker and how much memory they may take
+#define PDF_RASTERS 4
+#define PDF_RASTER_BYTES (256 << 20)
+// page labels looked up by the worker between two renders
+#define PDF_LABEL_CHUNK 32
+// continuous mode: pages with a texture, space between pages in points, and the smallest render width
+#define PDF_RESIDENT 12
+#define PDF_PAGE_GAP 8
+#define PDF_MIN_WIDTH 256
+
+// pages a word occurs on, ascending
+struct posting {
+	char *word;
+	int *pages;
+	int npages;
+	int cap;
+};
+
+// lowercase words of the whole document, filled page by page on a thread
+struct pdf_index {
+	pthread_t thread;
+	bool started;
+	atomic_bool stop;
+	atomic_int pages_done;
+	fz_context *ctx;
+	// guards the hash table, which is open addressed with a power of two size
+	pthread_mutex_t lock;
+	struct posting *table;
+	int table_size;
+	int nwords;
+	// every word in byte order for prefix lookups, the words new on a page are merged in
+	// once the page is done
+	char **sorted;
+	int nsorted;
+	char **fresh;
+	int nfresh;
+	int fresh_cap;
+};
+
+// rgba pixels of a rendered page
+struct raster {
+	int page;
+	int w, h;
+	// the transform of the page and the pixmap origin, to map text positions onto the pixels
+	fz_matrix ctm;
+	int x, y;
+	uint8_t *pixels;
+	size_t capacity;
+};
+
+struct page_list {
+	int page;
+	fz_display_list *list;
+};
+
+// renders pages that are about to be shown on a thread, and looks up page labels while idle
+struct pdf_render {
+	pthread_t thread;
+	bool started;
+	fz_context *ctx;
+	// guards everything below, cond signals new requests and finished renders
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool stop;
+	int request;
+	float request_width;
+	int rendering;
+	struct page_list lists[PDF_LISTS];
+	int next_list;
+	struct raster rasters[PDF_RASTERS];
+	int nrasters;
+	char **labels;
+	int labels_done;
+};
+
+// position of a page in continuous mode in points, estimated from the first page until known
+struct page_layout {
+	float y, w, h;
+	bool known;
+};
+
+struct page_texture {
+	int page;
+	Texture2D texture;
+};
 
 struct pdf {
 	fz_context *ctx;
 	fz_document *doc;
+	// backing memory of documents inside archives
+	struct archive_data member;
+	char *path;
 	int npages;
 	int current_page;
+	bool in_use;
+	uint64_t last_used;
+	// the file changed, the next open reads it again and continues on the same page
+	bool stale;
+	// of the file when it was opened, a cached document outside of the watched files is
+	// noticed to be stale by it
+	struct timespec mtime;
+
+	struct pdf_index index;
+	char *query;
+	int nhits;
+	// pages_done when nhits was counted, it is only counted again once more pages are indexed
+	int nhits_indexed;
+	// the last search found no hit in its direction among the pages indexed so far, it is
+	// run again by pdf_poll once more pages are indexed
+	bool search_pending;
+	int search_direction;
+	int search_indexed;
+
+	struct pdf_render render;
+	struct outline_entry *outline;
+	int noutline;
+	bool outline_loaded;
+
+	// continuous mode, only the pages around the viewport have textures
+	bool continuous;
+	struct page_layout *layout;
+	int scroll_to;
+	struct page_texture resident[PDF_RESIDENT];
 };
 
+// one context for all documents, so their fonts and glyph caches are shared
+static fz_context *base_ctx = NULL;
+static pthread_mutex_t fz_mutexes[FZ_LOCK_MAX];
+static struct pdf *cache[PDF_CACHED];
+static uint64_t use_counter = 0;
+
+static void fz_lock_cb(void *user, int lock) {
+	(void) user;
+	pthread_mutex_lock(&fz_mutexes[lock]);
+}
+
+static void fz_unlock_cb(void *user, int lock) {
+	(void) user;
+	pthread_mutex_unlock(&fz_mutexes[lock]);
+}
+
+// created on the first pdf, threads have to use fz_clone_context on it
+static fz_context *pdf_context(void) {
+	if (base_ctx != NULL) {
+		return base_ctx;
+	}
+
+	size_t store = FZ_STORE_DEFAULT;
+	const char *env = getenv(PDF_STORE_ENV);
+	if (env != NULL && atoi(env) > 0) {
+		store = (size_t) atoi(env) << 20;
+	}
+
+	for (int i = 0; i < FZ_LOCK_MAX; i++) {
+		pthread_mutex_init(&fz_mutexes[i], NULL);
+	}
+	fz_locks_context locks = {NULL, fz_lock_cb, fz_unlock_cb};
+	base_ctx = fz_new_context(NULL, &locks, store);
+	if (base_ctx != NULL) {
+		fz_register_document_handlers(base_ctx);
+	}
+	return base_ctx;
+}
+
+// documents must not be shared between threads, so every thread opens its own
+static fz_document *open_document(fz_context *ctx, const char *path, const struct archive_data *member) {
+	fz_document *doc = NULL;
+	fz_stream *stream = NULL;
+	fz_try (ctx) {
+		if (member->data) {
+			stream = fz_open_memory(ctx, member->data, member->size);
+			// mupdf picks the handler by the extension of the member
+			doc = fz_open_document_with_stream(ctx, path, stream);
+		} else {
+			doc = fz_open_document(ctx, path);
+		}
+	} fz_always (ctx) {
+		fz_drop_stream(ctx, stream);
+	} fz_catch (ctx) {
+		doc = NULL;
+	}
+	return doc;
+}
+
+// of the file the document is read from, the archive for members
+static struct timespec file_mtime(const char *path) {
+	const char *sep = archive_member_separator(path);
+	char *file = sep != NULL ? strndup(path, sep - path) : strdup(path);
+	struct stat st;
+	struct timespec mtime = stat(file, &st) == 0 ? st.st_mtim : (struct timespec){0};
+	free(file);
+	return mtime;
+}
+
 static struct pdf *pdf_new(const char *path) {
-	struct pdf *pdf = malloc(sizeof(struct pdf));
+	fz_context *ctx = pdf_context();
+	if (ctx == NULL) {
+		return NULL;
+	}
 
-	pdf->ctx = fz_new_context(NULL, NULL, FZ_STORE_DEFAULT);
-	fz_register_document_handlers(pdf->ctx);
+	struct pdf *pdf = calloc(1, sizeof(struct pdf));
+	pdf->ctx = ctx;
+	pdf->mtime = file_mtime(path);
 
-	fz_try (pdf->ctx) {
-		pdf->doc = fz_open_document(pdf->ctx, path);
-	} fz_catch (pdf->ctx) {
-		fz_drop_context(pdf->ctx);
+	if (archive_is_member(path) && !archive_read(path, &pdf->member)) {
+		free(pdf);
+		return NULL;
+	}
+
+	pdf->doc = open_document(ctx, path, &pdf->member);
+	fz_try (ctx) {
+		pdf->npages = pdf->doc ? fz_count_pages(ctx, pdf->doc) : 0;
+	} fz_catch (ctx) {
+		pdf->npages = 0;
+	}
+	if (pdf->npages == 0) {
+		fz_drop_document(ctx, pdf->doc);
+		archive_release(&pdf->member);
+		free(pdf);
 		return NULL;
 	}
 
-	pdf->npages = fz_count_pages(pdf->ctx, pdf->doc);
+	pdf->path = strdup(path);
 	pdf->current_page = 0;
+	pthread_mutex_init(&pdf->index.lock, NULL);
+	pthread_mutex_init(&pdf->render.lock, NULL);
+	pthread_cond_init(&pdf->render.cond, NULL);
+	pdf->render.request = -1;
+	pdf->render.rendering = -1;
 	return pdf;
 }
 
-Texture2D pdf_draw(struct pdf *pdf) {
-	static void *data = NULL;
-	static uint64_t datasize = 0;
+static bool is_word_char(int c) {
+	if (c < 128) {
+		return isalnum(c);
+	}
+	// nbsp, general punctuation and cjk punctuation separate words as well
+	return c != 0xa0 && (c < 0x2000 || c > 0x206f) && (c < 0x3000 || c > 0x303f);
+}
 
-	fz_page *page = fz_load_page(pdf->ctx, pdf->doc, pdf->current_page);
-	fz_rect r = fz_bound_page(pdf->ctx, page);
-	float x_ref = 5000.0;
-	float y_ref = x_ref * (r.y1 - r.y0) / (r.x1 - r.x0);
-	fz_matrix ctm = fz_scale(x_ref / (r.x1 - r.x0), y_ref / (r.y1 - r.y0));
-	fz_pixmap *pix = fz_new_pixmap_from_page(pdf->ctx, page, ctm, fz_device_rgb(pdf->ctx), 0);
+// splits text into lowercase utf-8 words, returns true when c ended the word in buf
+static bool split_word(char *buf, int *len, int c) {
+	if (is_word_char(c)) {
+		if (*len + FZ_UTFMAX < PDF_WORD_MAX) {
+			*len += fz_runetochar(buf + *len, fz_tolower(c));
+		}
+		return false;
+	}
 
-	if (!pix) {
-		return (Texture2D){0};
+	if (*len == 0) {
+		return false;
+	}
+	buf[*len] = '\0';
+	*len = 0;
+	return true;
+}
+
+static uint32_t hash_word(const char *word) {
+	uint32_t h = 2166136261u;
+	for (; *word; word++) {
+		h = (h ^ (unsigned char) *word) * 16777619u;
+	}
+	return h;
+}
+
+static void index_grow(struct pdf_index *index) {
+	struct posting *old = index->table;
+	int old_size = index->table_size;
+
+	index->table_size = old_size ? old_size * 2 : 1024;
+	index->table = calloc(index->table_size, sizeof(struct posting));
+	uint32_t mask = index->table_size - 1;
+	for (int i = 0; i < old_size; i++) {
+		if (old[i].word == NULL) {
+			continue;
+		}
+		uint32_t j = hash_word(old[i].word) & mask;
+		while (index->table[j].word != NULL) {
+			j = (j + 1) & mask;
+		}
+		index->table[j] = old[i];
+	}
+	free(old);
+}
+
+// called with the index lock held
+static struct posting *index_find(struct pdf_index *index, const char *word, bool insert) {
+	if (insert && (index->nwords + 1) * 10 > index->table_size * 7) {
+		index_grow(index);
+	}
+	if (index->table_size == 0) {
+		return NULL;
+	}
+
+	uint32_t mask = index->table_size - 1;
+	for (uint32_t i = hash_word(word) & mask;; i = (i + 1) & mask) {
+		struct posting *p = &index->table[i];
+		if (p->word == NULL) {
+			if (!insert) {
+				return NULL;
+			}
+			p->word = strdup(word);
+			index->nwords++;
+			if (index->nfresh == index->fresh_cap) {
+				index->fresh_cap = index->fresh_cap ? index->fresh_cap * 2 : 256;
+				index->fresh = realloc(index->fresh, index->fresh_cap * sizeof(char *));
+			}
+			index->fresh[index->nfresh++] = p->word;
+			return p;
+		}
+		if (strcmp(p->word, word) == 0) {
+			return p;
+		}
+	}
+}
+
+// pages are indexed in order, so the page lists stay sorted
+static void index_add(struct pdf_index *index, const char *word, int page) {
+	struct posting *p = index_find(index, word, true);
+	if (p->npages > 0 && p->pages[p->npages - 1] == page) {
+		return;
+	}
+	if (p->npages == p->cap) {
+		p->cap = p->cap ? p->cap * 2 : 4;
+		p->pages = realloc(p->pages, p->cap * sizeof(int));
+	}
+	p->pages[p->npages++] = page;
+}
+
+static int compare_word(const void *a, const void *b) {
+	return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+// called with the index lock held
+static void index_merge(struct pdf_index *index) {
+	if (index->nfresh == 0) {
+		return;
+	}
+
+	qsort(index->fresh, index->nfresh, sizeof(char *), compare_word);
+	int n = index->nsorted + index->nfresh;
+	index->sorted = realloc(index->sorted, n * sizeof(char *));
+	// merged from the back, so the sorted words are moved before their slots are written
+	for (int i = index->nsorted - 1, j = index->nfresh - 1, k = n - 1; j >= 0; k--) {
+		if (i >= 0 && strcmp(index->sorted[i], index->fresh[j]) > 0) {
+			index->sorted[k] = index->sorted[i--];
+		} else {
+			index->sorted[k] = index->fresh[j--];
+		}
+	}
+	index->nsorted = n;
+	index->nfresh = 0;
+}
+
+static void index_page(struct pdf_index *index, fz_stext_page *text, int page) {
+	char word[PDF_WORD_MAX];
+	int len = 0;
+
+	pthread_mutex_lock(&index->lock);
+	for (fz_stext_block *block = text->first_block; block != NULL; block = block->next) {
+		if (block->type != FZ_STEXT_BLOCK_TEXT) {
+			continue;
+		}
+		for (fz_stext_line *line = block->u.t.first_line; line != NULL; line = line->next) {
+			for (fz_stext_char *ch = line->first_char; ch != NULL; ch = ch->next) {
+				if (split_word(word, &len, ch->c)) {
+					index_add(index, word, page);
+				}
+			}
+			if (split_word(word, &len, ' ')) {
+				index_add(index, word, page);
+			}
+		}
+	}
+	index_merge(index);
+	pthread_mutex_unlock(&index->lock);
+}
+
+static void *index_thread(void *arg) {
+	struct pdf *pdf = arg;
+	struct pdf_index *index = &pdf->index;
+	fz_context *ctx = index->ctx;
+	fz_document *doc = open_document(ctx, pdf->path, &pdf->member);
+
+	for (int page = 0; doc != NULL && page < pdf->npages && !atomic_load(&index->stop); page++) {
+		fz_stext_page *text = NULL;
+		fz_try (ctx) {
+			text = fz_new_stext_page_from_page_number(ctx, doc, page, NULL);
+		} fz_catch (ctx) {
+			text = NULL;
+		}
+
+		if (text != NULL) {
+			index_page(index, text, page);
+			fz_drop_stext_page(ctx, text);
+		}
+		atomic_store(&index->pages_done, page + 1);
+		if ((page + 1) % PDF_INDEX_WAKE == 0) {
+			glfwPostEmptyEvent();
+		}
+	}
+
+	atomic_store(&index->pages_done, pdf->npages);
+	fz_drop_document(ctx, doc);
+	fz_drop_context(ctx);
+	glfwPostEmptyEvent();
+	return NULL;
+}
+
+// the index is only built once the document is searched
+static void index_start(struct pdf *pdf) {
+	struct pdf_index *index = &pdf->index;
+	if (index->started) {
+		return;
+	}
+
+	index->ctx = fz_clone_context(pdf->ctx);
+	if (index->ctx == NULL) {
+		return;
+	}
+	if (pthread_create(&index->thread, NULL, index_thread, pdf) != 0) {
+		fz_drop_context(index->ctx);
+		return;
+	}
+	index->started = true;
+}
+
+static void index_stop(struct pdf_index *index) {
+	if (index->started) {
+		atomic_store(&index->stop, true);
+		pthread_join(index->thread, NULL);
+	}
+	for (int i = 0; i < index->table_size; i++) {
+		free(index->table[i].word);
+		free(index->table[i].pages);
+	}
+	free(index->table);
+	free(index->sorted);
+	free(index->fresh);
+	pthread_mutex_destroy(&index->lock);
+}
+
+// keeps the pages that are in a and b, both sorted
+static int intersect(int *a, int na, const int *b, int nb) {
+	int n = 0;
+	for (int i = 0, j = 0; i < na && j < nb;) {
+		if (a[i] < b[j]) {
+			i++;
+		} else if (a[i] > b[j]) {
+			j++;
+		} else {
+			a[n++] = a[i];
+			i++;
+			j++;
+		}
+	}
+	return n;
+}
+
+// lowercase words of query, split like the indexed text, returns their number
+static int split_query(const char *query, char words[PDF_QUERY_WORDS][PDF_WORD_MAX]) {
+	int nwords = 0;
+	int len = 0;
+	for (const char *q = query;; ) {
+		int c = 0;
+		if (*q != '\0') {
+			q += fz_chartorune(&c, q);
+		}
+		if (nwords < PDF_QUERY_WORDS && split_word(words[nwords], &len, c == 0 ? ' ' : c)) {
+			nwords++;
+		}
+		if (c == 0) {
+			break;
+		}
+	}
+	return nwords;
+}
+
+// a word of the document is a hit if it starts with one of the query words, so that
+// "config" finds "configuration"; the index and the highlights both match this way
+static bool word_matches(const char *word, char words[PDF_QUERY_WORDS][PDF_WORD_MAX], int nwords) {
+	for (int i = 0; i < nwords; i++) {
+		if (strncmp(word, words[i], strlen(words[i])) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// the first of the sorted words that is not below word, called with the index lock held
+static int lower_bound(struct pdf_index *index, const char *word) {
+	int lo = 0;
+	int hi = index->nsorted;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (strcmp(index->sorted[mid], word) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+// the pages of every indexed word starting with prefix, ascending; the words with a prefix
+// are next to each other in the sorted words, called with the index lock held
+static int prefix_pages(struct pdf_index *index, const char *prefix, int npages, int **pages) {
+	size_t len = strlen(prefix);
+	bool *found = calloc(npages, sizeof(bool));
+	for (int i = lower_bound(index, prefix); i < index->nsorted && strncmp(index->sorted[i], prefix, len) == 0; i++) {
+		struct posting *p = index_find(index, index->sorted[i], false);
+		for (int j = 0; j < p->npages; j++) {
+			found[p->pages[j]] = true;
+		}
+	}
+
+	int n = 0;
+	*pages = malloc(npages * sizeof(int));
+	for (int page = 0; page < npages; page++) {
+		if (found[page]) {
+			(*pages)[n++] = page;
+		}
+	}
+	free(found);
+	return n;
+}
+
+// the pages indexed so far with a match of every word of query, pages must be freed
+static int index_lookup(struct pdf_index *index, const char *query, int npages, int **pages) {
+	char words[PDF_QUERY_WORDS][PDF_WORD_MAX];
+	int nwords = split_query(query, words);
+
+	*pages = NULL;
+	int n = 0;
+	pthread_mutex_lock(&index->lock);
+	for (int i = 0; i < nwords; i++) {
+		int *matches;
+		int nmatches = prefix_pages(index, words[i], npages, &matches);
+		if (i == 0) {
+			*pages = matches;
+			n = nmatches;
+		} else {
+			n = intersect(*pages, n, matches, nmatches);
+			free(matches);
+		}
+		if (n == 0) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&index->lock);
+	return n;
+}
+
+static fz_matrix page_ctm(fz_rect r, float width) {
+	float y_ref = width * (r.y1 - r.y0) / (r.x1 - r.x0);
+	return fz_scale(width / (r.x1 - r.x0), y_ref / (r.y1 - r.y0));
+}
+
+// the display list of a page, shared between the threads, must be dropped by the caller
+static fz_display_list *page_list(struct pdf *pdf, fz_context *ctx, fz_document *doc, int page) {
+	struct pdf_render *render = &pdf->render;
+	fz_display_list *list = NULL;
+
+	pthread_mutex_lock(&render->lock);
+	for (int i = 0; i < PDF_LISTS && list == NULL; i++) {
+		if (render->lists[i].list != NULL && render->lists[i].page == page) {
+			list = fz_keep_display_list(ctx, render->lists[i].list);
+		}
+	}
+	pthread_mutex_unlock(&render->lock);
+	if (list != NULL) {
+		return list;
+	}
+
+	fz_page *p = NULL;
+	fz_try (ctx) {
+		p = fz_load_page(ctx, doc, page);
+		list = fz_new_display_list_from_page(ctx, p);
+	} fz_always (ctx) {
+		fz_drop_page(ctx, p);
+	} fz_catch (ctx) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&render->lock);
+	struct page_list *slot = &render->lists[render->next_list];
+	render->next_list = (render->next_list + 1) % PDF_LISTS;
+	fz_drop_display_list(ctx, slot->list);
+	slot->page = page;
+	slot->list = fz_keep_display_list(ctx, list);
+	pthread_mutex_unlock(&render->lock);
+	return list;
+}
+
+// renders width pixels wide into r->pixels, which is reused if it is large enough,
+// timings are only recorded on the main thread
+static bool rasterize(fz_context *ctx, fz_display_list *list, float width, struct raster *r, bool record) {
+	double start = perf_now();
+	fz_matrix ctm = page_ctm(fz_bound_display_list(ctx, list), width);
+	fz_pixmap *pix = NULL;
+	fz_try (ctx) {
+		pix = fz_new_pixmap_from_display_list(ctx, list, ctm, fz_device_rgb(ctx), 0);
+	} fz_catch (ctx) {
+		return false;
+	}
+	if (record) {
+		perf_record(PERF_DECODE, start);
 	}
 
 	if (pix->n != 3) {
-		fz_drop_pixmap(pdf->ctx, pix);
-		return (Texture2D){0};
+		fz_drop_pixmap(ctx, pix);
+		return false;
 	}
 
-	uint64_t size = (uint64_t) pix->w * (uint64_t) pix->h * (uint64_t) pix->n;
-	if (size > datasize) {
-		datasize = size;
-		free(data);
-		data = malloc(datasize);
+	start = perf_now();
+	size_t size = (size_t) pix->w * pix->h * 4;
+	if (size > r->capacity) {
+		free(r->pixels);
+		r->pixels = malloc(size);
+		r->capacity = size;
+	}
+	for (int y = 0; y < pix->h; y++) {
+		uint8_t *row = r->pixels + (size_t) y * pix->w * 4;
+		pixel_to_rgba(row, pix->samples + y * pix->stride, pix->w, PIXEL_RGB);
 	}
+	if (record) {
+		perf_record(PERF_CONVERT, start);
+	}
+
+	r->w = pix->w;
+	r->h = pix->h;
+	r->x = pix->x;
+	r->y = pix->y;
+	r->ctm = ctm;
+	fz_drop_pixmap(ctx, pix);
+	return true;
+}
+
+// called with the render lock held, the oldest rasters make room for the new one
+static void raster_insert(struct pdf_render *render, struct raster raster) {
+	size_t bytes = raster.capacity;
+	for (int i = 0; i < render->nrasters; i++) {
+		bytes += render->rasters[i].capacity;
+	}
+
+	while (render->nrasters > 0 && (render->nrasters == PDF_RASTERS || bytes > PDF_RASTER_BYTES)) {
+		bytes -= render->rasters[0].capacity;
+		free(render->rasters[0].pixels);
+		render->nrasters--;
+		memmove(render->rasters, render->rasters + 1, render->nrasters * sizeof(struct raster));
+	}
+	render->rasters[render->nrasters++] = raster;
+}
+
+// takes a prefetched raster of page that is at least width wide out of the cache,
+// with wait it waits if the worker is rendering the page right now
+static bool raster_take(struct pdf_render *render, int page, int width, bool wait, struct raster *out) {
+	bool found = false;
+	pthread_mutex_lock(&render->lock);
+	while (wait && render->started && render->rendering == page) {
+		pthread_cond_wait(&render->cond, &render->lock);
+	}
+	for (int i = 0; i < render->nrasters && !found; i++) {
+		if (render->rasters[i].page == page && render->rasters[i].w >= width) {
+			*out = render->rasters[i];
+			render->nrasters--;
+			memmove(render->rasters + i, render->rasters + i + 1, (render->nrasters - i) * sizeof(struct raster));
+			found = true;
+		}
+	}
+	pthread_mutex_unlock(&render->lock);
+	return found;
+}
+
+static void load_labels(struct pdf *pdf, fz_context *ctx, fz_document *doc, int first, int n) {
+	char label[64];
+	for (int i = first; i < first + n; i++) {
+		fz_page *page = NULL;
+		fz_try (ctx) {
+			page = fz_load_page(ctx, doc, i);
+			fz_page_label(ctx, page, label, sizeof(label));
+		} fz_always (ctx) {
+			fz_drop_page(ctx, page);
+		} fz_catch (ctx) {
+			label[0] = '\0';
+		}
+
+		pthread_mutex_lock(&pdf->render.lock);
+		pdf->render.labels[i] = strdup(label);
+		pdf->render.labels_done = i + 1;
+		pthread_mutex_unlock(&pdf->render.lock);
+	}
+}
+
+static void *render_thread(void *arg) {
+	struct pdf *pdf = arg;
+	struct pdf_render *render = &pdf->render;
+	fz_context *ctx = render->ctx;
+	fz_document *doc = open_document(ctx, pdf->path, &pdf->member);
+
+	pthread_mutex_lock(&render->lock);
+	while (!render->stop && doc != NULL) {
+		if (render->request >= 0) {
+			int page = render->request;
+			float width = render->request_width;
+			render->request = -1;
+			render->rendering = page;
+			pthread_mutex_unlock(&render->lock);
+
+			struct raster raster = {.page = page};
+			fz_display_list *list = page_list(pdf, ctx, doc, page);
+			bool ok = list != NULL && rasterize(ctx, list, width, &raster, false);
+			fz_drop_display_list(ctx, list);
+
+			pthread_mutex_lock(&render->lock);
+			if (ok) {
+				raster_insert(render, raster);
+			} else {
+				free(raster.pixels);
+			}
+			render->rendering = -1;
+			pthread_cond_broadcast(&render->cond);
+			// continuous mode shows the page as soon as the main loop wakes up
+			glfwPostEmptyEvent();
+		} else if (render->labels_done < pdf->npages) {
+			int first = render->labels_done;
+			pthread_mutex_unlock(&render->lock);
+			load_labels(pdf, ctx, doc, first, fminf(PDF_LABEL_CHUNK, pdf->npages - first));
+			pthread_mutex_lock(&render->lock);
+		} else {
+			pthread_cond_wait(&render->cond, &render->lock);
+		}
+	}
+	pthread_mutex_unlock(&render->lock);
+
+	fz_drop_document(ctx, doc);
+	fz_drop_context(ctx);
+	return NULL;
+}
+
+// the worker is started by the first prefetch or label lookup
+static void render_start(struct pdf *pdf) {
+	struct pdf_render *render = &pdf->render;
+	if (render->started) {
+		return;
+	}
+
+	render->ctx = fz_clone_context(pdf->ctx);
+	if (render->ctx == NULL) {
+		return;
+	}
+	render->labels = calloc(pdf->npages, sizeof(char *));
+	if (pthread_create(&render->thread, NULL, render_thread, pdf) != 0) {
+		fz_drop_context(render->ctx);
+		return;
+	}
+	render->started = true;
+}
 
-	memcpy(data, pix->samples, size);
+static void render_stop(struct pdf *pdf) {
+	struct pdf_render *render = &pdf->render;
+	if (render->started) {
+		pthread_mutex_lock(&render->lock);
+		render->stop = true;
+		pthread_cond_broadcast(&render->cond);
+		pthread_mutex_unlock(&render->lock);
+		pthread_join(render->thread, NULL);
+	}
+
+	for (int i = 0; i < PDF_LISTS; i++) {
+		fz_drop_display_list(pdf->ctx, render->lists[i].list);
+	}
+	for (int i = 0; i < render->nrasters; i++) {
+		free(render->rasters[i].pixels);
+	}
+	for (int i = 0; i < render->labels_done; i++) {
+		free(render->labels[i]);
+	}
+	free(render->labels);
+	pthread_mutex_destroy(&render->lock);
+	pthread_cond_destroy(&render->cond);
+}
+
+static void pdf_free(struct pdf *pdf) {
+	index_stop(&pdf->index);
+	render_stop(pdf);
+	for (int i = 0; i < pdf->noutline; i++) {
+		free((char *) pdf->outline[i].title);
+	}
+	free(pdf->outline);
+	free(pdf->layout);
+	free(pdf->query);
+	fz_drop_document(pdf->ctx, pdf->doc);
+	archive_release(&pdf->member);
+	free(pdf->path);
+	free(pdf);
+}
+
+// a free slot, or the least recently used document that is not shown, -1 if all are in use
+static int pdf_cache_slot(void) {
+	int slot = -1;
+	for (int i = 0; i < PDF_CACHED; i++) {
+		if (cache[i] == NULL) {
+			return i;
+		}
+		if (!cache[i]->in_use && (slot < 0 || cache[i]->last_used < cache[slot]->last_used)) {
+			slot = i;
+		}
+	}
+	return slot;
+}
+
+// returns the cached document of path or opens and caches it
+static struct pdf *pdf_get(const char *path) {
+	for (int i = 0; i < PDF_CACHED; i++) {
+		if (cache[i] == NULL || strcmp(cache[i]->path, path) != 0) {
+			continue;
+		}
+
+		struct timespec mtime = file_mtime(path);
+		if (mtime.tv_sec != cache[i]->mtime.tv_sec || mtime.tv_nsec != cache[i]->mtime.tv_nsec) {
+			cache[i]->stale = true;
+		}
+		// a file that cannot be read yet keeps showing its previous version
+		struct pdf *pdf = cache[i]->stale && !cache[i]->in_use ? pdf_new(path) : NULL;
+		if (pdf != NULL) {
+			pdf->current_page = cache[i]->current_page < pdf->npages ? cache[i]->current_page : pdf->npages - 1;
+			pdf_free(cache[i]);
+			cache[i] = pdf;
+		} else {
+			perf_count(PERF_CACHE_HIT, 1);
+		}
+		cache[i]->in_use = true;
+		cache[i]->last_used = ++use_counter;
+		return cache[i];
+	}
+	perf_count(PERF_CACHE_MISS, 1);
+
+	struct pdf *pdf = pdf_new(path);
+	if (pdf == NULL) {
+		return NULL;
+	}
+	pdf->in_use = true;
+	pdf->last_used = ++use_counter;
+
+	// all slots are shown, the document is freed on close
+	int slot = pdf_cache_slot();
+	if (slot < 0) {
+		return pdf;
+	}
+	if (cache[slot] != NULL) {
+		pdf_free(cache[slot]);
+	}
+	cache[slot] = pdf;
+	return pdf;
+}
+
+static void pdf_release(struct pdf *pdf) {
+	pdf->in_use = false;
+
+	// prefetched rasters are large, cached documents keep only their display lists
+	pthread_mutex_lock(&pdf->render.lock);
+	for (int i = 0; i < pdf->render.nrasters; i++) {
+		free(pdf->render.rasters[i].pixels);
+	}
+	pdf->render.nrasters = 0;
+	pthread_mutex_unlock(&pdf->render.lock);
+
+	for (int i = 0; i < PDF_CACHED; i++) {
+		if (cache[i] == pdf) {
+			return;
+		}
+	}
+	pdf_free(pdf);
+}
+
+// a shown document is read again once it is closed, since its render thread still uses it
+static void pdf_forget(const char *path) {
+	for (int i = 0; i < PDF_CACHED; i++) {
+		if (cache[i] != NULL && strcmp(cache[i]->path, path) == 0) {
+			cache[i]->stale = true;
+		}
+	}
+}
+
+static void tint_rect(struct raster *raster, fz_rect r) {
+	r = fz_transform_rect(r, raster->ctm);
+	int x0 = fmaxf(r.x0 - raster->x, 0);
+	int y0 = fmaxf(r.y0 - raster->y, 0);
+	int x1 = fminf(r.x1 - raster->x, raster->w);
+	int y1 = fminf(r.y1 - raster->y, raster->h);
+	for (int y = y0; y < y1; y++) {
+		uint8_t *p = raster->pixels + ((size_t) y * raster->w + x0) * 4;
+		for (int x = x0; x < x1; x++, p += 4) {
+			p[0] = (p[0] + 255) / 2;
+			p[1] = (p[1] + 255) / 2;
+			p[2] = p[2] / 2;
+		}
+	}
+}
+
+// tints the words of the rendered page that match the search query, split and matched
+// like the index so that every page searched to shows its hits
+static void pdf_highlight(struct pdf *pdf, fz_display_list *list, struct raster *raster) {
+	char words[PDF_QUERY_WORDS][PDF_WORD_MAX];
+	int nwords = split_query(pdf->query, words);
+	fz_stext_page *text = NULL;
+	fz_try (pdf->ctx) {
+		text = fz_new_stext_page_from_display_list(pdf->ctx, list, NULL);
+	} fz_catch (pdf->ctx) {
+		return;
+	}
+
+	char word[PDF_WORD_MAX];
+	int len = 0;
+	int hits = 0;
+	fz_rect bounds = fz_empty_rect;
+	for (fz_stext_block *block = text->first_block; block != NULL; block = block->next) {
+		if (block->type != FZ_STEXT_BLOCK_TEXT) {
+			continue;
+		}
+		for (fz_stext_line *line = block->u.t.first_line; line != NULL; line = line->next) {
+			for (fz_stext_char *ch = line->first_char;; ch = ch->next) {
+				// the end of the line ends its last word
+				int c = ch != NULL ? ch->c : ' ';
+				if (split_word(word, &len, c)) {
+					if (hits < PDF_MAX_HITS && word_matches(word, words, nwords)) {
+						tint_rect(raster, bounds);
+						hits++;
+					}
+					bounds = fz_empty_rect;
+				}
+				if (ch == NULL) {
+					break;
+				}
+				if (is_word_char(c)) {
+					bounds = fz_union_rect(bounds, fz_rect_from_quad(ch->quad));
+				}
+			}
+		}
+	}
+	fz_drop_stext_page(pdf->ctx, text);
+}
+
+Texture2D pdf_draw(struct pdf *pdf) {
+	// reused between pages that were not prefetched
+	static struct raster scratch = {0};
+
+	int page = pdf->current_page;
+	struct raster prefetched;
+	bool is_prefetched = raster_take(&pdf->render, page, PDF_RENDER_WIDTH, true, &prefetched);
+	struct raster *raster = is_prefetched ? &prefetched : &scratch;
+
+	fz_display_list *list = NULL;
+	if (!is_prefetched || pdf->query != NULL) {
+		list = page_list(pdf, pdf->ctx, pdf->doc, page);
+	}
+	if (!is_prefetched && (list == NULL || !rasterize(pdf->ctx, list, PDF_RENDER_WIDTH, &scratch, true))) {
+		fz_drop_display_list(pdf->ctx, list);
+		return (Texture2D){0};
+	}
+
+	if (pdf->query != NULL && list != NULL) {
+		pdf_highlight(pdf, list, raster);
+	}
+	fz_drop_display_list(pdf->ctx, list);
 
 	Image i = {
-		.data = data,
-		.width = pix->w,
-		.height = pix->h,
-		.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8,
+		.data = raster->pixels,
+		.width = raster->w,
+		.height = raster->h,
+		.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
 		.mipmaps = 1,
 	};
-
-	fz_drop_pixmap(pdf->ctx, pix);
-	return LoadTextureFromImage(i);
+	Texture2D texture = perf_load_texture(i);
+	if (is_prefetched) {
+		free(prefetched.pixels);
+	}
+	return texture;
 }
 
 static const char *pdf_text(struct media *self) {
 	struct pdf *pdf = self->userdata;
-	return TextFormat("(%d/%d)", pdf->current_page + 1, pdf->npages);
+	if (pdf->query == NULL) {
+		return TextFormat("(%d/%d)", pdf->current_page + 1, pdf->npages);
+	}
+
+	int done = atomic_load(&pdf->index.pages_done);
+	if (done != pdf->nhits_indexed) {
+		int *pages;
+		pdf->nhits = index_lookup(&pdf->index, pdf->query, pdf->npages, &pages);
+		pdf->nhits_indexed = done;
+		free(pages);
+	}
+	if (done < pdf->npages) {
+		return TextFormat("(%d/%d) \"%s\": %d pages, indexed %d/%d", pdf->current_page + 1, pdf->npages,
+		                  pdf->query, pdf->nhits, done, pdf->npages);
+	}
+	return TextFormat("(%d/%d) \"%s\": %d pages", pdf->current_page + 1, pdf->npages, pdf->query, pdf->nhits);
+}
+
+static void unload_resident(struct pdf *pdf) {
+	for (int i = 0; i < PDF_RESIDENT; i++) {
+		perf_unload_texture(pdf->resident[i].texture);
+		pdf->resident[i] = (struct page_texture){0};
+	}
+}
+
+// continuous mode scrolls to the current page instead of rendering it
+static void pdf_redraw(struct media *self) {
+	struct pdf *pdf = self->userdata;
+	if (pdf->continuous) {
+		pdf->scroll_to = pdf->current_page;
+		return;
+	}
+	perf_unload_texture(self->texture);
+	self->texture = pdf_draw(pdf);
 }
 
 static void pdf_set_index(struct media *self, int index_mode, int amount) {
 	struct pdf *pdf = self->userdata;
+	pdf->search_pending = false;
 	if (index_mode == INDEX_RELATIVE) {
 		pdf->current_page += amount;
+	} else if (index_mode == INDEX_EXACT) {
+		pdf->current_page = amount < 0 ? 0 : amount >= pdf->npages ? pdf->npages - 1 : amount;
 	} else {
 		pdf->current_page = pdf->npages * amount / 10;
 	}
@@ -89,33 +1064,479 @@ static void pdf_set_index(struct media *self, int index_mode, int amount) {
 		pdf->current_page += pdf->npages;
 	}
 
-	UnloadTexture(self->texture);
-	self->texture = pdf_draw(pdf);
+	pdf_redraw(self);
+}
+
+// the next page with a hit in direction from the current one; the search only wraps around
+// once the whole document is indexed, -1 if there is no hit yet
+static int search_target(struct pdf *pdf, int direction) {
+	int done = atomic_load(&pdf->index.pages_done);
+	int *pages;
+	int n = index_lookup(&pdf->index, pdf->query, pdf->npages, &pages);
+	pdf->nhits = n;
+	pdf->nhits_indexed = done;
+	bool indexed = done >= pdf->npages;
+
+	int target = -1;
+	int current = pdf->current_page;
+	if (direction >= 0) {
+		for (int i = 0; i < n && target < 0; i++) {
+			if (pages[i] > current || (direction == 0 && pages[i] == current)) {
+				target = pages[i];
+			}
+		}
+		target = target < 0 && indexed && n > 0 ? pages[0] : target;
+	} else {
+		for (int i = n - 1; i >= 0 && target < 0; i--) {
+			if (pages[i] < current) {
+				target = pages[i];
+			}
+		}
+		target = target < 0 && indexed && n > 0 ? pages[n - 1] : target;
+	}
+	free(pages);
+	return target;
+}
+
+// hits come from the index as far as it is built, a search that finds nothing yet is
+// continued by pdf_poll as the index grows
+static void pdf_search(struct media *self, const char *query, int direction) {
+	struct pdf *pdf = self->userdata;
+	bool changed = pdf->query == NULL || strcmp(pdf->query, query) != 0;
+	if (changed) {
+		free(pdf->query);
+		pdf->query = strdup(query);
+		unload_resident(pdf);
+	}
+	index_start(pdf);
+
+	int current = pdf->current_page;
+	int target = search_target(pdf, direction);
+	pdf->search_indexed = atomic_load(&pdf->index.pages_done);
+	pdf->search_pending = target < 0 && pdf->search_indexed < pdf->npages;
+	pdf->search_direction = direction;
+
+	if (target >= 0) {
+		pdf->current_page = target;
+	}
+	if (changed || pdf->current_page != current) {
+		pdf_redraw(self);
+	}
+}
+
+static void pdf_poll(struct media *self) {
+	struct pdf *pdf = self->userdata;
+	int indexed = atomic_load(&pdf->index.pages_done);
+	if (!pdf->search_pending || indexed == pdf->search_indexed) {
+		return;
+	}
+
+	pdf->search_indexed = indexed;
+	int target = search_target(pdf, pdf->search_direction);
+	pdf->search_pending = target < 0 && indexed < pdf->npages;
+	if (target >= 0 && target != pdf->current_page) {
+		pdf->current_page = target;
+		pdf_redraw(self);
+	}
+}
+
+static void flatten_outline(struct pdf *pdf, fz_outline *item, int level) {
+	for (; item != NULL; item = item->next) {
+		int page = -1;
+		fz_try (pdf->ctx) {
+			page = fz_page_number_from_location(pdf->ctx, pdf->doc, item->page);
+		} fz_catch (pdf->ctx) {
+			page = -1;
+		}
+
+		if (page >= 0 && item->title != NULL) {
+			pdf->outline = realloc(pdf->outline, (pdf->noutline + 1) * sizeof(struct outline_entry));
+			pdf->outline[pdf->noutline++] = (struct outline_entry){strdup(item->title), level, page};
+		}
+		flatten_outline(pdf, item->down, level + 1);
+	}
+}
+
+static int pdf_outline(struct media *self, const struct outline_entry **entries) {
+	struct pdf *pdf = self->userdata;
+	if (!pdf->outline_loaded) {
+		pdf->outline_loaded = true;
+		fz_outline *outline = NULL;
+		fz_try (pdf->ctx) {
+			outline = fz_load_outline(pdf->ctx, pdf->doc);
+		} fz_catch (pdf->ctx) {
+			outline = NULL;
+		}
+		flatten_outline(pdf, outline, 0);
+		fz_drop_outline(pdf->ctx, outline);
+	}
+
+	*entries = pdf->outline;
+	return pdf->noutline;
+}
+
+// asks the worker to render page, replacing the previous request that it has not started yet
+static void render_request(struct pdf *pdf, int page, float width) {
+	struct pdf_render *render = &pdf->render;
+	render_start(pdf);
+
+	pthread_mutex_lock(&render->lock);
+	bool done = render->rendering == page;
+	for (int i = 0; i < render->nrasters && !done; i++) {
+		done = render->rasters[i].page == page && render->rasters[i].w >= width;
+	}
+	if (!done) {
+		render->request = page;
+		render->request_width = width;
+		pthread_cond_broadcast(&render->cond);
+	}
+	pthread_mutex_unlock(&render->lock);
+}
+
+static void pdf_prefetch(struct media *self, int index) {
+	struct pdf *pdf = self->userdata;
+	if (index >= 0 && index < pdf->npages && index != pdf->current_page && !pdf->continuous) {
+		render_request(pdf, index, PDF_RENDER_WIDTH);
+	}
+}
+
+// labels are looked up by the worker, pages it has not reached yet are not found
+static int pdf_find_label(struct media *self, const char *label) {
+	struct pdf *pdf = self->userdata;
+	struct pdf_render *render = &pdf->render;
+	render_start(pdf);
+
+	int page = -1;
+	pthread_mutex_lock(&render->lock);
+	for (int i = 0; i < render->labels_done && page < 0; i++) {
+		if (strcmp(render->labels[i], label) == 0) {
+			page = i;
+		}
+	}
+	pthread_mutex_unlock(&render->lock);
+	return page;
+}
+
+static void relayout(struct pdf *pdf, int page) {
+	for (int i = page + 1; i < pdf->npages; i++) {
+		pdf->layout[i].y = pdf->layout[i - 1].y + pdf->layout[i - 1].h + PDF_PAGE_GAP;
+	}
+}
+
+// measures the page from its bounds without interpreting its contents, the pages below
+// move if the estimate was off
+static void measure_page(struct pdf *pdf, int page) {
+	struct page_layout *l = &pdf->layout[page];
+	fz_page *p = NULL;
+	fz_try (pdf->ctx) {
+		p = fz_load_page(pdf->ctx, pdf->doc, page);
+		fz_rect r = fz_bound_page(pdf->ctx, p);
+		l->w = r.x1 - r.x0;
+		l->h = r.y1 - r.y0;
+	} fz_always (pdf->ctx) {
+		fz_drop_page(pdf->ctx, p);
+	} fz_catch (pdf->ctx) {
+		// the estimate is kept
+	}
+	l->known = true;
+	relayout(pdf, page);
+}
+
+// the last page starting above y
+static int page_at(struct pdf *pdf, float y) {
+	int lo = 0;
+	int hi = pdf->npages - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (pdf->layout[mid].y <= y) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return lo;
+}
+
+static struct page_texture *find_resident(struct pdf *pdf, int page) {
+	for (int i = 0; i < PDF_RESIDENT; i++) {
+		if (pdf->resident[i].texture.id != 0 && pdf->resident[i].page == page) {
+			return &pdf->resident[i];
+		}
+	}
+	return NULL;
+}
+
+// uploads a raster the worker finished, replacing the texture furthest from the current page
+static void make_resident(struct pdf *pdf, struct raster *raster) {
+	struct page_texture *slot = find_resident(pdf, raster->page);
+	for (int i = 0; i < PDF_RESIDENT && slot == NULL; i++) {
+		if (pdf->resident[i].texture.id == 0) {
+			slot = &pdf->resident[i];
+		}
+	}
+	if (slot == NULL) {
+		slot = &pdf->resident[0];
+		for (int i = 1; i < PDF_RESIDENT; i++) {
+			if (abs(pdf->resident[i].page - pdf->current_page) > abs(slot->page - pdf->current_page)) {
+				slot = &pdf->resident[i];
+			}
+		}
+	}
+
+	if (pdf->query != NULL) {
+		fz_display_list *list = page_list(pdf, pdf->ctx, pdf->doc, raster->page);
+		if (list != NULL) {
+			pdf_highlight(pdf, list, raster);
+			fz_drop_display_list(pdf->ctx, list);
+		}
+	}
+
+	Image i = {
+		.data = raster->pixels,
+		.width = raster->w,
+		.height = raster->h,
+		.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+		.mipmaps = 1,
+	};
+	perf_unload_texture(slot->texture);
+	slot->page = raster->page;
+	slot->texture = perf_load_texture(i);
+	free(raster->pixels);
+}
+
+// the render width for the page's size on screen, in powers of two so that zooming re-renders rarely
+static int wanted_width(struct pdf *pdf, int page, float fit, float zoom) {
+	float width = pdf->layout[page].w * fit * zoom;
+	int w = PDF_MIN_WIDTH;
+	while (w < width && w < PDF_RENDER_WIDTH) {
+		w *= 2;
+	}
+	return w < PDF_RENDER_WIDTH ? w : PDF_RENDER_WIDTH;
+}
+
+// pages are stacked in points times fit, which makes the first page as wide as the screen
+static void pdf_draw_continuous(struct media *self, Camera2D *camera) {
+	struct pdf *pdf = self->userdata;
+	float fit = GetScreenWidth() / pdf->layout[0].w;
+	if (pdf->scroll_to >= 0) {
+		camera->offset = (Vector2){0, 0};
+		camera->target = (Vector2){0, pdf->layout[pdf->scroll_to].y * fit};
+		pdf->scroll_to = -1;
+	}
+
+	// the viewport and one screen above and below it, in points
+	float top = GetScreenToWorld2D((Vector2){0, 0}, *camera).y / fit;
+	float bottom = GetScreenToWorld2D((Vector2){0, GetScreenHeight()}, *camera).y / fit;
+	float margin = bottom - top;
+	int first = page_at(pdf, top - margin);
+	for (int i = first; i < pdf->npages && pdf->layout[i].y < bottom + margin; i++) {
+		if (!pdf->layout[i].known) {
+			measure_page(pdf, i);
+		}
+	}
+	int visible_first = page_at(pdf, top);
+	int visible_last = page_at(pdf, bottom);
+	int last = page_at(pdf, bottom + margin);
+	int current = page_at(pdf, (top + bottom) / 2);
+	pdf->current_page = current;
+
+	// finished renders become textures and the missing page closest to the center is requested,
+	// only the PDF_RESIDENT closest pages are considered so that textures are never evicted in a cycle
+	bool requested = false;
+	for (int n = 0, d = 0; n < PDF_RESIDENT && (current - d >= first || current + d <= last); d++) {
+		for (int side = d == 0 ? 1 : -1; side <= 1 && n < PDF_RESIDENT; side += 2) {
+			int i = current + side * d;
+			if (i < first || i > last) {
+				continue;
+			}
+			n++;
+
+			int width = wanted_width(pdf, i, fit, camera->zoom);
+			struct page_texture *t = find_resident(pdf, i);
+			if (t != NULL && t->texture.width >= width) {
+				continue;
+			}
+
+			struct raster raster;
+			if (raster_take(&pdf->render, i, width, false, &raster)) {
+				make_resident(pdf, &raster);
+			} else if (!requested) {
+				render_request(pdf, i, width);
+				requested = true;
+			}
+		}
+	}
+
+	for (int i = visible_first; i <= visible_last; i++) {
+		struct page_layout *l = &pdf->layout[i];
+		Rectangle dest = {(pdf->layout[0].w - l->w) / 2 * fit, l->y * fit, l->w * fit, l->h * fit};
+		struct page_texture *t = find_resident(pdf, i);
+		if (t == NULL) {
+			DrawRectangleRec(dest, DARKGRAY);
+			continue;
+		}
+		Rectangle source = {0, 0, t->texture.width, t->texture.height};
+		DrawTexturePro(t->texture, source, dest, (Vector2){0, 0}, 0, WHITE);
+	}
+}
+
+// the layout is estimated from the first page on the first switch, every page is measured when it comes into view
+static void pdf_toggle_continuous(struct media *self) {
+	struct pdf *pdf = self->userdata;
+	pdf->continuous = !pdf->continuous;
+
+	if (!pdf->continuous) {
+		unload_resident(pdf);
+		self->draw = NULL;
+		pdf_redraw(self);
+		return;
+	}
+
+	if (pdf->layout == NULL) {
+		pdf->layout = calloc(pdf->npages, sizeof(struct page_layout));
+		// letter size in case the first page fails to load
+		pdf->layout[0] = (struct page_layout){0, 612, 792, false};
+		measure_page(pdf, 0);
+		for (int i = 1; i < pdf->npages; i++) {
+			pdf->layout[i].w = pdf->layout[0].w;
+			pdf->layout[i].h = pdf->layout[0].h;
+		}
+		relayout(pdf, 0);
+	}
+
+	perf_unload_texture(self->texture);
+	self->texture = (Texture2D){0};
+	self->draw = pdf_draw_continuous;
+	pdf->scroll_to = pdf->current_page;
+}
+
+static void pdf_close(struct media *self) {
+	struct pdf *pdf = self->userdata;
+	pdf->continuous = false;
+	unload_resident(pdf);
+	perf_unload_texture(self->texture);
+	pdf_release(self->userdata);
+	*self = (struct media){0};
 }
 
 static bool pdf_open(struct media *media, const char *mediapath) {
-	if (!IsFileExtension(mediapath, ".pdf") && !IsFileExtension(mediapath, ".PDF")) {
+	if (!IsFileExtension(mediapath, DOCUMENT_EXTENSIONS)) {
 		return false;
 	}
 
-	if (media->userdata) {
-		return true;
+	struct pdf *pdf = pdf_get(mediapath);
+	if (pdf == NULL) {
+		*media = (struct media){0};
+		return false;
 	}
 
 	*media = (struct media){
 		.text = pdf_text,
 		.set_index = pdf_set_index,
-		.userdata = NULL,
+		.close = pdf_close,
+		.search = pdf_search,
+		.poll = pdf_poll,
+		.outline = pdf_outline,
+		.prefetch = pdf_prefetch,
+		.find_label = pdf_find_label,
+		.toggle_continuous = pdf_toggle_continuous,
+		.userdata = pdf,
 		.texture = {0},
 	};
 
-	media->userdata = pdf_new(mediapath);
-	media->texture = pdf_draw(media->userdata);
+	media->texture = pdf_draw(pdf);
+	return true;
+}
+
+// --export opens documents on a context per thread, the last one stays open so that the
+// pages of a file exported one after another on a thread share it
+static _Thread_local struct {
+	fz_context *ctx;
+	fz_document *doc;
+	struct archive_data member;
+	char *path;
+} exporting;
+
+void pdf_export_done(void) {
+	if (exporting.ctx != NULL) {
+		fz_drop_document(exporting.ctx, exporting.doc);
+		fz_drop_context(exporting.ctx);
+	}
+	archive_release(&exporting.member);
+	free(exporting.path);
+	exporting.ctx = NULL;
+	exporting.doc = NULL;
+	exporting.path = NULL;
+}
+
+static bool export_document(const char *path) {
+	if (exporting.doc != NULL && strcmp(exporting.path, path) == 0) {
+		return true;
+	}
+
+	pdf_export_done();
+	fz_context *base = pdf_context();
+	if (base == NULL || (archive_is_member(path) && !archive_read(path, &exporting.member))) {
+		return false;
+	}
+	exporting.ctx = fz_clone_context(base);
+	if (exporting.ctx == NULL) {
+		return false;
+	}
+	exporting.doc = open_document(exporting.ctx, path, &exporting.member);
+	exporting.path = strdup(path);
+	return exporting.doc != NULL;
+}
+
+int pdf_export_count(const char *path) {
+	if (!export_document(path)) {
+		return -1;
+	}
+
+	int n = -1;
+	fz_try (exporting.ctx) {
+		n = fz_count_pages(exporting.ctx, exporting.doc);
+	} fz_catch (exporting.ctx) {
+		n = -1;
+	}
+	return n;
+}
+
+bool pdf_export_page(const char *path, int page, float dpi, Image *image) {
+	if (!export_document(path)) {
+		return false;
+	}
+
+	fz_context *ctx = exporting.ctx;
+	fz_pixmap *pix = NULL;
+	fz_try (ctx) {
+		pix = fz_new_pixmap_from_page_number(ctx, exporting.doc, page, fz_scale(dpi / 72, dpi / 72), fz_device_rgb(ctx), 0);
+	} fz_catch (ctx) {
+		return false;
+	}
+	if (pix->n != 3) {
+		fz_drop_pixmap(ctx, pix);
+		return false;
+	}
+
+	uint8_t *pixels = malloc((size_t) pix->w * pix->h * 3);
+	for (int y = 0; y < pix->h; y++) {
+		memcpy(pixels + (size_t) y * pix->w * 3, pix->samples + y * pix->stride, (size_t) pix->w * 3);
+	}
+	*image = (Image){
+		.data = pixels,
+		.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8,
+		.width = pix->w,
+		.height = pix->h,
+		.mipmaps = 1,
+	};
+	fz_drop_pixmap(ctx, pix);
 	return true;
 }
 
 struct module pdf_init(void) {
 	return (struct module) {
 		.open = pdf_open,
+		.forget = pdf_forget,
 	};
 }
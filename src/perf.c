@@ -0,0 +1,122 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "perf.h"
+#include "trace.h"
+
+// weight of the newest sample in the moving average
+#define PERF_SMOOTHING 0.1
+
+struct perf_timer {
+	double last;
+	double avg;
+	double max;
+};
+
+static const char *stage_names[PERF_STAGE_COUNT] = {"frame", "decode", "convert", "upload"};
+// stages are timed and counted on the decoding, export and reload threads as well as the
+// main one, which reads everything for the overlay
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct perf_timer timers[PERF_STAGE_COUNT];
+static long counters[PERF_COUNTER_COUNT];
+static long long vram_bytes = 0;
+static int decode_ahead = -1;
+
+double perf_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void perf_record_duration(enum perf_stage stage, double seconds) {
+	trace_complete(stage_names[stage], perf_now() - seconds, seconds);
+
+	pthread_mutex_lock(&lock);
+	struct perf_timer *t = &timers[stage];
+	t->last = seconds;
+	t->avg = t->avg == 0 ? seconds : t->avg + PERF_SMOOTHING * (seconds - t->avg);
+	t->max = seconds > t->max ? seconds : t->max;
+	pthread_mutex_unlock(&lock);
+}
+
+void perf_record(enum perf_stage stage, double start) {
+	perf_record_duration(stage, perf_now() - start);
+}
+
+void perf_count(enum perf_counter counter, int amount) {
+	pthread_mutex_lock(&lock);
+	counters[counter] += amount;
+	pthread_mutex_unlock(&lock);
+}
+
+void perf_set_decode_ahead(int depth) {
+	pthread_mutex_lock(&lock);
+	decode_ahead = depth;
+	pthread_mutex_unlock(&lock);
+}
+
+Texture2D perf_load_texture(Image image) {
+	double start = perf_now();
+	Texture2D t = LoadTextureFromImage(image);
+	perf_record(PERF_UPLOAD, start);
+
+	if (t.id > 0) {
+		pthread_mutex_lock(&lock);
+		vram_bytes += GetPixelDataSize(t.width, t.height, t.format);
+		pthread_mutex_unlock(&lock);
+	}
+	return t;
+}
+
+void perf_update_texture(Texture2D texture, const void *pixels) {
+	double start = perf_now();
+	UpdateTexture(texture, pixels);
+	perf_record(PERF_UPLOAD, start);
+}
+
+void perf_unload_texture(Texture2D texture) {
+	if (texture.id > 0) {
+		pthread_mutex_lock(&lock);
+		vram_bytes -= GetPixelDataSize(texture.width, texture.height, texture.format);
+		pthread_mutex_unlock(&lock);
+	}
+	UnloadTexture(texture);
+}
+
+const char *perf_text(void) {
+	static char text[512];
+
+	// a consistent snapshot, formatted without holding the lock
+	struct perf_timer timer[PERF_STAGE_COUNT];
+	long counter[PERF_COUNTER_COUNT];
+	pthread_mutex_lock(&lock);
+	memcpy(timer, timers, sizeof(timer));
+	memcpy(counter, counters, sizeof(counter));
+	long long vram = vram_bytes;
+	int ahead = decode_ahead;
+	pthread_mutex_unlock(&lock);
+
+	int len = 0;
+	for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+		struct perf_timer *t = &timer[i];
+		len += snprintf(text + len, sizeof(text) - len, "%-8s %7.2f ms (avg %7.2f, max %7.2f)\n",
+		                stage_names[i], 1000 * t->last, 1000 * t->avg, 1000 * t->max);
+	}
+
+	long hits = counter[PERF_CACHE_HIT];
+	long lookups = hits + counter[PERF_CACHE_MISS];
+	len += snprintf(text + len, sizeof(text) - len, "cache    %ld/%ld hits (%.0f%%)\n",
+	                hits, lookups, lookups > 0 ? 100.0 * hits / lookups : 0.0);
+	len += snprintf(text + len, sizeof(text) - len, "vram     %.1f MiB", vram / (1024.0 * 1024.0));
+
+	if (ahead >= 0) {
+		len += snprintf(text + len, sizeof(text) - len, "\nahead    %d frames", ahead);
+	}
+	len += snprintf(text + len, sizeof(text) - len, "\ndropped  %ld frames", counter[PERF_DROPPED_FRAMES]);
+	if (counter[PERF_MISSED_SLIDES] > 0) {
+		snprintf(text + len, sizeof(text) - len, "\nmissed   %ld slide deadlines", counter[PERF_MISSED_SLIDES]);
+	}
+	return text;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <raylib.h>
+
+// stages timed for the performance overlay
+enum perf_stage {
+	PERF_FRAME,
+	PERF_DECODE,
+	PERF_CONVERT,
+	PERF_UPLOAD,
+	PERF_STAGE_COUNT,
+};
+
+enum perf_counter {
+	PERF_CACHE_HIT,
+	PERF_CACHE_MISS,
+	PERF_DROPPED_FRAMES,
+	PERF_MISSED_SLIDES,
+	PERF_COUNTER_COUNT,
+};
+
+// monotonic time in seconds, usable before the window exists
+double perf_now(void);
+// recording and counting may happen on any thread
+// records the time since start (from perf_now) for the stage
+void perf_record(enum perf_stage stage, double start);
+void perf_record_duration(enum perf_stage stage, double seconds);
+void perf_count(enum perf_counter counter, int amount);
+// number of frames decoded ahead of the shown one, -1 if not applicable
+void perf_set_decode_ahead(int depth);
+
+// LoadTextureFromImage/UpdateTexture/UnloadTexture with upload timing and vram accounting
+Texture2D perf_load_texture(Image image);
+void perf_update_texture(Texture2D texture, const void *pixels);
+void perf_unload_texture(Texture2D texture);
+
+const char *perf_text(void);
@@ -0,0 +1,222 @@
+#include <pthread.h>
+
+#include "pixel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PIXEL_NEON
+#endif
+
+typedef void (*pixel_fn)(uint8_t *dst, const uint8_t *src, size_t npixels, enum pixel_order order);
+typedef void (*absdiff_fn)(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t npixels, int gain);
+
+void pixel_to_rgba_scalar(uint8_t *dst, const uint8_t *src, size_t npixels, enum pixel_order order) {
+	int r = order == PIXEL_RGB ? 0 : 2;
+	int b = 2 - r;
+	for (size_t i = 0; i < npixels; i++) {
+		dst[0] = src[r];
+		dst[1] = src[1];
+		dst[2] = src[b];
+		dst[3] = 0xff;
+		dst += 4;
+		src += 3;
+	}
+}
+
+// plain c is enough here, compilers vectorize these loops on their own
+void pixel_gray_to_rgba(uint8_t *dst, const uint8_t *src, size_t npixels, bool alpha) {
+	int stride = alpha ? 2 : 1;
+	for (size_t i = 0; i < npixels; i++) {
+		dst[0] = src[0];
+		dst[1] = src[0];
+		dst[2] = src[0];
+		dst[3] = alpha ? src[1] : 0xff;
+		dst += 4;
+		src += stride;
+	}
+}
+
+void pixel_absdiff_scalar(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t npixels, int gain) {
+	for (size_t i = 0; i < 4 * npixels; i++) {
+		int d = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+		d <<= gain;
+		dst[i] = (i & 3) == 3 ? 0xff : d > 0xff ? 0xff : d;
+	}
+}
+
+#ifdef PIXEL_X86
+// shuffle of four 3 byte pixels into four 4 byte pixels, the alpha bytes are zeroed and or'ed in later.
+// offset is the byte the first pixel starts at in the loaded 16 bytes.
+static __attribute__((target("ssse3"))) __m128i shuffle_mask(enum pixel_order order, int offset) {
+	int r = order == PIXEL_RGB ? 0 : 2;
+	int b = 2 - r;
+	char m[16];
+	for (int p = 0; p < 4; p++) {
+		m[4 * p + 0] = offset + 3 * p + r;
+		m[4 * p + 1] = offset + 3 * p + 1;
+		m[4 * p + 2] = offset + 3 * p + b;
+		m[4 * p + 3] = (char) 0x80;
+	}
+	return _mm_loadu_si128((const __m128i *) m);
+}
+
+// 16 pixels per iteration from 48 bytes, the last load is moved back by 4 bytes to stay inside them
+static __attribute__((target("ssse3"))) void pixel_to_rgba_ssse3(uint8_t *dst, const uint8_t *src, size_t npixels, enum pixel_order order) {
+	__m128i mask = shuffle_mask(order, 0);
+	__m128i mask_last = shuffle_mask(order, 4);
+	__m128i alpha = _mm_set1_epi32((int) 0xff000000);
+
+	size_t i = 0;
+	for (; i + 16 <= npixels; i += 16) {
+		const uint8_t *s = src + 3 * i;
+		__m128i *d = (__m128i *) (dst + 4 * i);
+		__m128i a = _mm_loadu_si128((const __m128i *) (s + 0));
+		__m128i b = _mm_loadu_si128((const __m128i *) (s + 12));
+		__m128i c = _mm_loadu_si128((const __m128i *) (s + 24));
+		__m128i e = _mm_loadu_si128((const __m128i *) (s + 32));
+		_mm_storeu_si128(d + 0, _mm_or_si128(_mm_shuffle_epi8(a, mask), alpha));
+		_mm_storeu_si128(d + 1, _mm_or_si128(_mm_shuffle_epi8(b, mask), alpha));
+		_mm_storeu_si128(d + 2, _mm_or_si128(_mm_shuffle_epi8(c, mask), alpha));
+		_mm_storeu_si128(d + 3, _mm_or_si128(_mm_shuffle_epi8(e, mask_last), alpha));
+	}
+
+	pixel_to_rgba_scalar(dst + 4 * i, src + 3 * i, npixels - i, order);
+}
+
+// 32 pixels per iteration, each 256 bit shuffle handles two 128 bit lanes of four pixels
+static __attribute__((target("avx2"))) void pixel_to_rgba_avx2(uint8_t *dst, const uint8_t *src, size_t npixels, enum pixel_order order) {
+	__m128i m = shuffle_mask(order, 0);
+	__m128i m_last = shuffle_mask(order, 4);
+	__m256i mask = _mm256_set_m128i(m, m);
+	__m256i mask_last = _mm256_set_m128i(m_last, m);
+	__m256i alpha = _mm256_set1_epi32((int) 0xff000000);
+
+	size_t i = 0;
+	for (; i + 32 <= npixels; i += 32) {
+		const uint8_t *s = src + 3 * i;
+		__m256i *d = (__m256i *) (dst + 4 * i);
+		__m256i a = _mm256_loadu2_m128i((const __m128i *) (s + 12), (const __m128i *) (s + 0));
+		__m256i b = _mm256_loadu2_m128i((const __m128i *) (s + 36), (const __m128i *) (s + 24));
+		__m256i c = _mm256_loadu2_m128i((const __m128i *) (s + 60), (const __m128i *) (s + 48));
+		__m256i e = _mm256_loadu2_m128i((const __m128i *) (s + 80), (const __m128i *) (s + 72));
+		_mm256_storeu_si256(d + 0, _mm256_or_si256(_mm256_shuffle_epi8(a, mask), alpha));
+		_mm256_storeu_si256(d + 1, _mm256_or_si256(_mm256_shuffle_epi8(b, mask), alpha));
+		_mm256_storeu_si256(d + 2, _mm256_or_si256(_mm256_shuffle_epi8(c, mask), alpha));
+		_mm256_storeu_si256(d + 3, _mm256_or_si256(_mm256_shuffle_epi8(e, mask_last), alpha));
+	}
+
+	pixel_to_rgba_ssse3(dst + 4 * i, src + 3 * i, npixels - i, order);
+}
+
+// the difference of unsigned bytes is the or of both saturating subtractions, one of them is 0
+static __attribute__((target("sse2"))) void pixel_absdiff_sse2(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t npixels, int gain) {
+	__m128i alpha = _mm_set1_epi32((int) 0xff000000);
+
+	size_t i = 0;
+	for (; i + 4 <= npixels; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (a + 4 * i));
+		__m128i y = _mm_loadu_si128((const __m128i *) (b + 4 * i));
+		__m128i d = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+		for (int g = 0; g < gain; g++) {
+			d = _mm_adds_epu8(d, d);
+		}
+		_mm_storeu_si128((__m128i *) (dst + 4 * i), _mm_or_si128(d, alpha));
+	}
+
+	pixel_absdiff_scalar(dst + 4 * i, a + 4 * i, b + 4 * i, npixels - i, gain);
+}
+
+static __attribute__((target("avx2"))) void pixel_absdiff_avx2(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t npixels, int gain) {
+	__m256i alpha = _mm256_set1_epi32((int) 0xff000000);
+
+	size_t i = 0;
+	for (; i + 8 <= npixels; i += 8) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) (a + 4 * i));
+		__m256i y = _mm256_loadu_si256((const __m256i *) (b + 4 * i));
+		__m256i d = _mm256_or_si256(_mm256_subs_epu8(x, y), _mm256_subs_epu8(y, x));
+		for (int g = 0; g < gain; g++) {
+			d = _mm256_adds_epu8(d, d);
+		}
+		_mm256_storeu_si256((__m256i *) (dst + 4 * i), _mm256_or_si256(d, alpha));
+	}
+
+	pixel_absdiff_sse2(dst + 4 * i, a + 4 * i, b + 4 * i, npixels - i, gain);
+}
+#endif
+
+#ifdef PIXEL_NEON
+static void pixel_to_rgba_neon(uint8_t *dst, const uint8_t *src, size_t npixels, enum pixel_order order) {
+	size_t i = 0;
+	for (; i + 16 <= npixels; i += 16) {
+		uint8x16x3_t in = vld3q_u8(src + 3 * i);
+		uint8x16x4_t out;
+		out.val[0] = order == PIXEL_RGB ? in.val[0] : in.val[2];
+		out.val[1] = in.val[1];
+		out.val[2] = order == PIXEL_RGB ? in.val[2] : in.val[0];
+		out.val[3] = vdupq_n_u8(0xff);
+		vst4q_u8(dst + 4 * i, out);
+	}
+
+	pixel_to_rgba_scalar(dst + 4 * i, src + 3 * i, npixels - i, order);
+}
+
+static void pixel_absdiff_neon(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t npixels, int gain) {
+	uint8x16_t alpha = vreinterpretq_u8_u32(vdupq_n_u32(0xff000000));
+
+	size_t i = 0;
+	for (; i + 4 <= npixels; i += 4) {
+		uint8x16_t d = vabdq_u8(vld1q_u8(a + 4 * i), vld1q_u8(b + 4 * i));
+		for (int g = 0; g < gain; g++) {
+			d = vqaddq_u8(d, d);
+		}
+		vst1q_u8(dst + 4 * i, vorrq_u8(d, alpha));
+	}
+
+	pixel_absdiff_scalar(dst + 4 * i, a + 4 * i, b + 4 * i, npixels - i, gain);
+}
+#endif
+
+// images are decoded on several threads at once, so the selection runs once
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+static pixel_fn impl = pixel_to_rgba_scalar;
+static absdiff_fn absdiff_impl = pixel_absdiff_scalar;
+static const char *impl_name = "scalar";
+
+static void pixel_select(void) {
+#if defined(PIXEL_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		impl = pixel_to_rgba_avx2;
+		absdiff_impl = pixel_absdiff_avx2;
+		impl_name = "avx2";
+	} else if (__builtin_cpu_supports("ssse3")) {
+		impl = pixel_to_rgba_ssse3;
+		absdiff_impl = pixel_absdiff_sse2;
+		impl_name = "ssse3";
+	} else if (__builtin_cpu_supports("sse2")) {
+		absdiff_impl = pixel_absdiff_sse2;
+	}
+#elif defined(PIXEL_NEON)
+	impl = pixel_to_rgba_neon;
+	absdiff_impl = pixel_absdiff_neon;
+	impl_name = "neon";
+#endif
+}
+
+void pixel_to_rgba(uint8_t *dst, const uint8_t *src, size_t npixels, enum pixel_order order) {
+	pthread_once(&select_once, pixel_select);
+	impl(dst, src, npixels, order);
+}
+
+void pixel_absdiff(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t npixels, int gain) {
+	pthread_once(&select_once, pixel_select);
+	absdiff_impl(dst, a, b, npixels, gain);
+}
+
+const char *pixel_impl_name(void) {
+	pthread_once(&select_once, pixel_select);
+	return impl_name;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Packed 3 byte pixels are converted to 4 byte RGBA pixels with opaque alpha
+// before upload, so the driver does not have to convert them on the cpu. Gray
+// and gray-alpha pixels are expanded to RGBA as well.
+// The fastest implementation for the cpu is picked on the first call.
+
+enum pixel_order {
+	PIXEL_RGB,
+	PIXEL_BGR,
+};
+
+void pixel_to_rgba(uint8_t *dst, const uint8_t *src, size_t npixels, enum pixel_order order);
+// 1 byte gray or, with alpha, 2 byte gray-alpha pixels
+void pixel_gray_to_rgba(uint8_t *dst, const uint8_t *src, size_t npixels, bool alpha);
+// plain c implementation the vectorized ones are checked against
+void pixel_to_rgba_scalar(uint8_t *dst, const uint8_t *src, size_t npixels, enum pixel_order order);
+// |a - b| of every channel of 4 byte pixels, doubled gain times with saturation so that small
+// differences become visible; alpha is opaque
+void pixel_absdiff(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t npixels, int gain);
+void pixel_absdiff_scalar(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t npixels, int gain);
+// name of the implementation pixel_to_rgba uses
+const char *pixel_impl_name(void);
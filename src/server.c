@@ -0,0 +1,198 @@
+// SO_PEERCRED
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "module.h"
+#include "server.h"
+
+// a client has this long to send its paths, the thread serves one client at a time
+#define RECEIVE_TIMEOUT 2
+// bytes of paths a client may send
+#define RECEIVE_MAX (16 << 20)
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static char **pending = NULL;
+static int n_pending = 0;
+
+static struct sockaddr_un socket_address(void) {
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	if (dir != NULL) {
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/imgview2.sock", dir);
+	} else {
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/imgview2-%d.sock", (int) getuid());
+	}
+	return addr;
+}
+
+// paths are only exchanged with processes of the same user, anyone can bind the socket in /tmp
+static bool same_user(int fd) {
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == getuid();
+}
+
+// the connected socket or -1 with errno set
+static int server_connect(void) {
+	struct sockaddr_un addr = socket_address();
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		int error = errno;
+		close(fd);
+		errno = error;
+		return -1;
+	}
+	if (!same_user(fd)) {
+		close(fd);
+		errno = EACCES;
+		return -1;
+	}
+	return fd;
+}
+
+static bool write_all(int fd, const char *data, size_t size) {
+	while (size > 0) {
+		ssize_t n = write(fd, data, size);
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+// paths are sent null terminated, the end of the list is the end of the connection
+bool server_forward(const char **paths, int n) {
+	int fd = server_connect();
+	if (fd < 0) {
+		return false;
+	}
+
+	bool ok = true;
+	for (int i = 0; i < n && ok; i++) {
+		char absolute[PATH_MAX];
+		const char *path = realpath(paths[i], absolute) != NULL ? absolute : paths[i];
+		ok = write_all(fd, path, strlen(path) + 1);
+	}
+
+	close(fd);
+	return ok;
+}
+
+static void receive(int fd) {
+	struct timeval timeout = {.tv_sec = RECEIVE_TIMEOUT};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	size_t size = 0;
+	size_t cap = 4096;
+	char *data = malloc(cap);
+	ssize_t n;
+	while ((n = read(fd, data + size, cap - size)) > 0) {
+		size += n;
+		if (size == cap && cap < RECEIVE_MAX) {
+			cap *= 2;
+			data = realloc(data, cap);
+		} else if (size == cap) {
+			break;
+		}
+	}
+	// a client that timed out or sent too much did not send a complete list
+	if (n != 0) {
+		free(data);
+		return;
+	}
+
+	// a last path without its terminator is cut off and dropped
+	int count = 0;
+	char **paths = NULL;
+	for (size_t i = 0, len; i < size && (len = strnlen(data + i, size - i)) < size - i; i += len + 1) {
+		paths = realloc(paths, (count + 1) * sizeof(char *));
+		paths[count++] = strndup(data + i, len);
+	}
+	free(data);
+
+	if (count == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	for (int i = 0; i < n_pending; i++) {
+		free(pending[i]);
+	}
+	free(pending);
+	pending = paths;
+	n_pending = count;
+	pthread_mutex_unlock(&lock);
+
+	glfwPostEmptyEvent();
+}
+
+static void *server_thread(void *arg) {
+	int listener = (int) (long) arg;
+	for (;;) {
+		int fd = accept(listener, NULL, NULL);
+		if (fd >= 0) {
+			if (same_user(fd)) {
+				receive(fd);
+			}
+			close(fd);
+		}
+	}
+	return NULL;
+}
+
+bool server_start(void) {
+	struct sockaddr_un addr = socket_address();
+	int running = server_connect();
+	if (running >= 0) {
+		close(running);
+		fprintf(stderr, "%s: a server is already running\n", addr.sun_path);
+		return false;
+	}
+	// a socket nobody accepts on is left over from a server that died, any other socket
+	// there belongs to someone else and makes the bind fail
+	if (errno == ECONNREFUSED) {
+		unlink(addr.sun_path);
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return false;
+	}
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+		perror(addr.sun_path);
+		close(fd);
+		return false;
+	}
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, server_thread, (void *) (long) fd) != 0) {
+		close(fd);
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+
+char **server_poll(int *n) {
+	pthread_mutex_lock(&lock);
+	char **paths = pending;
+	*n = n_pending;
+	pending = NULL;
+	n_pending = 0;
+	pthread_mutex_unlock(&lock);
+	return paths;
+}
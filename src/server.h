@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdbool.h>
+
+// A viewer started with --server listens on a unix domain socket. Later
+// invocations hand their paths to it and exit, so the running instance can
+// show them with its window, gl context and caches already warm.
+
+// sends the paths to a running server, returns false if there is none
+bool server_forward(const char **paths, int n);
+// starts listening in a background thread
+bool server_start(void);
+// paths received since the last call or NULL, the array and strings are owned by the caller
+char **server_poll(int *n);
@@ -0,0 +1,210 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "module.h"
+#include "stream.h"
+
+// bytes read ahead of the consumer, the reading thread waits while they are full
+#define STREAM_BUFFER (16 << 20)
+// bytes the format is sniffed from
+#define STREAM_MAGIC 32
+#define STREAMS 4
+
+struct stream {
+	char *path;
+	int fd;
+	pthread_t thread;
+
+	// guards everything below, cond signals data read ahead and space freed
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned char *ring;
+	size_t start;
+	size_t count;
+	bool eof;
+	// bytes handed to stream_read, a partly consumed stream cannot be read whole anymore
+	size_t consumed;
+
+	unsigned char magic[STREAM_MAGIC];
+	size_t magic_len;
+
+	unsigned char *data;
+	size_t size;
+	bool complete;
+};
+
+static pthread_mutex_t streams_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stream *streams[STREAMS];
+
+bool stream_is_stream(const char *path) {
+	if (strcmp(path, "-") == 0) {
+		return true;
+	}
+
+	struct stat st;
+	return stat(path, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode) || S_ISSOCK(st.st_mode));
+}
+
+// reads straight into the free part of the ring, which the consumer does not touch
+static void *stream_thread(void *arg) {
+	struct stream *stream = arg;
+	pthread_mutex_lock(&stream->lock);
+	while (!stream->eof) {
+		if (stream->count == STREAM_BUFFER) {
+			pthread_cond_wait(&stream->cond, &stream->lock);
+			continue;
+		}
+
+		size_t end = (stream->start + stream->count) % STREAM_BUFFER;
+		size_t space = end >= stream->start ? STREAM_BUFFER - end : stream->start - end;
+		if (space > STREAM_BUFFER - stream->count) {
+			space = STREAM_BUFFER - stream->count;
+		}
+		pthread_mutex_unlock(&stream->lock);
+		ssize_t n = read(stream->fd, stream->ring + end, space);
+		pthread_mutex_lock(&stream->lock);
+
+		if (n > 0) {
+			stream->count += n;
+		} else {
+			stream->eof = true;
+		}
+		pthread_cond_broadcast(&stream->cond);
+		glfwPostEmptyEvent();
+	}
+	pthread_mutex_unlock(&stream->lock);
+	return NULL;
+}
+
+// the first bytes are copied without consuming them, the thread may still be reading them
+static void stream_sniff(struct stream *stream) {
+	pthread_mutex_lock(&stream->lock);
+	while (stream->count < STREAM_MAGIC && !stream->eof) {
+		pthread_cond_wait(&stream->cond, &stream->lock);
+	}
+	stream->magic_len = stream->count < STREAM_MAGIC ? stream->count : STREAM_MAGIC;
+	memcpy(stream->magic, stream->ring + stream->start, stream->magic_len);
+	pthread_mutex_unlock(&stream->lock);
+}
+
+static struct stream *stream_open(const char *path) {
+	int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stream *stream = calloc(1, sizeof(struct stream));
+	stream->path = strdup(path);
+	stream->fd = fd;
+	stream->ring = malloc(STREAM_BUFFER);
+	pthread_mutex_init(&stream->lock, NULL);
+	pthread_cond_init(&stream->cond, NULL);
+	if (pthread_create(&stream->thread, NULL, stream_thread, stream) != 0) {
+		stream->eof = true;
+	}
+	stream_sniff(stream);
+	return stream;
+}
+
+struct stream *stream_get(const char *path) {
+	pthread_mutex_lock(&streams_lock);
+	struct stream *stream = NULL;
+	int free_slot = -1;
+	for (int i = 0; i < STREAMS && stream == NULL; i++) {
+		if (streams[i] == NULL) {
+			free_slot = free_slot < 0 ? i : free_slot;
+		} else if (strcmp(streams[i]->path, path) == 0) {
+			stream = streams[i];
+		}
+	}
+	if (stream == NULL && free_slot >= 0) {
+		stream = streams[free_slot] = stream_open(path);
+	}
+	pthread_mutex_unlock(&streams_lock);
+	return stream;
+}
+
+// formats of IMAGE_EXTENSIONS that start with a magic number, webp goes to the video module
+const char *stream_image_type(struct stream *stream) {
+	const unsigned char *m = stream->magic;
+	size_t n = stream->magic_len;
+	if (n >= 8 && memcmp(m, "\x89PNG\r\n\x1a\n", 8) == 0) {
+		return ".png";
+	} else if (n >= 3 && memcmp(m, "\xff\xd8\xff", 3) == 0) {
+		return ".jpg";
+	} else if (n >= 4 && memcmp(m, "GIF8", 4) == 0) {
+		return ".gif";
+	} else if (n >= 2 && memcmp(m, "BM", 2) == 0) {
+		return ".bmp";
+	} else if (n >= 4 && memcmp(m, "qoif", 4) == 0) {
+		return ".qoi";
+	} else if (n >= 4 && memcmp(m, "8BPS", 4) == 0) {
+		return ".psd";
+	} else if (n >= 4 && memcmp(m, "DDS ", 4) == 0) {
+		return ".dds";
+	} else if (n >= 2 && m[0] == '#' && m[1] == '?') {
+		return ".hdr";
+	} else if (n >= 2 && m[0] == 'P' && m[1] >= '1' && m[1] <= '6') {
+		return ".ppm";
+	}
+	return NULL;
+}
+
+int stream_read(struct stream *stream, unsigned char *buf, int size) {
+	pthread_mutex_lock(&stream->lock);
+	while (stream->count == 0 && !stream->eof) {
+		pthread_cond_wait(&stream->cond, &stream->lock);
+	}
+
+	size_t n = 0;
+	while (n < (size_t) size && stream->count > 0) {
+		size_t chunk = STREAM_BUFFER - stream->start;
+		chunk = chunk < stream->count ? chunk : stream->count;
+		chunk = chunk < size - n ? chunk : size - n;
+		memcpy(buf + n, stream->ring + stream->start, chunk);
+		stream->start = (stream->start + chunk) % STREAM_BUFFER;
+		stream->count -= chunk;
+		n += chunk;
+	}
+	stream->consumed += n;
+	pthread_cond_broadcast(&stream->cond);
+	pthread_mutex_unlock(&stream->lock);
+	return n;
+}
+
+bool stream_read_all(struct stream *stream, const unsigned char **data, size_t *size) {
+	if (!stream->complete) {
+		pthread_mutex_lock(&stream->lock);
+		bool consumed = stream->consumed > 0;
+		pthread_mutex_unlock(&stream->lock);
+		if (consumed) {
+			return false;
+		}
+
+		size_t cap = STREAM_BUFFER;
+		stream->data = malloc(cap);
+		int n;
+		while ((n = stream_read(stream, stream->data + stream->size, cap - stream->size)) > 0) {
+			stream->size += n;
+			if (stream->size == cap) {
+				cap *= 2;
+				stream->data = realloc(stream->data, cap);
+			}
+		}
+		stream->complete = true;
+	}
+
+	*data = stream->data;
+	*size = stream->size;
+	return true;
+}
+
+bool stream_complete(struct stream *stream, const unsigned char **data, size_t *size) {
+	*data = stream->data;
+	*size = stream->size;
+	return stream->complete;
+}
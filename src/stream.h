@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Input that can only be read once and not seeked: "-" for stdin, fifos, sockets and
+// character devices. A thread reads ahead into a bounded buffer while the video module
+// consumes it through acinerella's callbacks; images are read to the end and kept, since
+// they are decoded from memory again whenever they are reopened.
+
+struct stream;
+
+bool stream_is_stream(const char *path);
+// the stream of path, opened on the first call and kept for the rest of the run
+struct stream *stream_get(const char *path);
+// extension of the image format the stream starts with, NULL if it is no still image format
+const char *stream_image_type(struct stream *stream);
+// blocks until data is available, returns 0 at the end of the stream
+int stream_read(struct stream *stream, unsigned char *buf, int size);
+// reads the rest of the stream, the data stays valid for the rest of the run
+bool stream_read_all(struct stream *stream, const unsigned char **data, size_t *size);
+// true once stream_read_all has read the whole stream
+bool stream_complete(struct stream *stream, const unsigned char **data, size_t *size);
@@ -0,0 +1,125 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "perf.h"
+#include "trace.h"
+
+#define TRACE_CHUNK_EVENTS 16384
+
+struct trace_event {
+	const char *name;
+	char phase;
+	double ts;
+	double dur;
+};
+
+struct trace_chunk {
+	struct trace_event events[TRACE_CHUNK_EVENTS];
+	_Atomic int count;
+	struct trace_chunk *_Atomic next;
+};
+
+// one buffer per thread, only written by its owner
+struct trace_buffer {
+	int tid;
+	struct trace_chunk *first;
+	struct trace_chunk *last;
+	struct trace_buffer *next;
+};
+
+static bool enabled = false;
+static const char *trace_path = NULL;
+static double trace_start = 0;
+static struct trace_buffer *_Atomic buffers = NULL;
+static _Atomic int next_tid = 1;
+static _Thread_local struct trace_buffer *local = NULL;
+
+void trace_init(const char *path) {
+	trace_path = path;
+	trace_start = perf_now();
+	enabled = true;
+}
+
+static struct trace_buffer *get_buffer(void) {
+	if (local != NULL) {
+		return local;
+	}
+
+	struct trace_buffer *b = calloc(1, sizeof(struct trace_buffer));
+	b->tid = atomic_fetch_add(&next_tid, 1);
+	b->first = b->last = calloc(1, sizeof(struct trace_chunk));
+	b->next = atomic_load(&buffers);
+	while (!atomic_compare_exchange_weak(&buffers, &b->next, b));
+
+	local = b;
+	return b;
+}
+
+static void record(const char *name, char phase, double ts, double dur) {
+	struct trace_buffer *b = get_buffer();
+	struct trace_chunk *c = b->last;
+	int n = atomic_load_explicit(&c->count, memory_order_relaxed);
+	if (n == TRACE_CHUNK_EVENTS) {
+		struct trace_chunk *next = calloc(1, sizeof(struct trace_chunk));
+		atomic_store_explicit(&c->next, next, memory_order_release);
+		b->last = c = next;
+		n = 0;
+	}
+
+	c->events[n] = (struct trace_event){name, phase, ts - trace_start, dur};
+	atomic_store_explicit(&c->count, n + 1, memory_order_release);
+}
+
+void trace_begin(const char *name) {
+	if (enabled) {
+		record(name, 'B', perf_now(), 0);
+	}
+}
+
+void trace_end(const char *name) {
+	if (enabled) {
+		record(name, 'E', perf_now(), 0);
+	}
+}
+
+void trace_complete(const char *name, double start, double duration) {
+	if (enabled) {
+		record(name, 'X', start, duration);
+	}
+}
+
+void trace_write(void) {
+	if (!enabled) {
+		return;
+	}
+
+	FILE *f = fopen(trace_path, "w");
+	if (f == NULL) {
+		perror(trace_path);
+		return;
+	}
+
+	int pid = getpid();
+	bool first = true;
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (struct trace_buffer *b = atomic_load(&buffers); b != NULL; b = b->next) {
+		for (struct trace_chunk *c = b->first; c != NULL; c = atomic_load_explicit(&c->next, memory_order_acquire)) {
+			int n = atomic_load_explicit(&c->count, memory_order_acquire);
+			for (int i = 0; i < n; i++) {
+				struct trace_event *e = &c->events[i];
+				fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+				        first ? "" : ",\n", e->name, e->phase, 1e6 * e->ts, pid, b->tid);
+				if (e->phase == 'X') {
+					fprintf(f, ",\"dur\":%.3f", 1e6 * e->dur);
+				}
+				fprintf(f, "}");
+				first = false;
+			}
+		}
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// Chrome trace format event recording, enabled with --trace <file>.
+// Every thread appends to its own buffer, so recording takes no locks.
+// Names must be string literals (or otherwise outlive the trace).
+
+void trace_init(const char *path);
+void trace_begin(const char *name);
+void trace_end(const char *name);
+// event that already finished, start is a perf_now timestamp
+void trace_complete(const char *name, double start, double duration);
+// writes all recorded events to the file given to trace_init
+void trace_write(void);
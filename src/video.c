@@ -3,64 +3,385 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "acinerella.h"
+#include "archive.h"
 #include "module.h"
+#include "perf.h"
+#include "stream.h"
+
+// bytes ahead of the demuxer position that are requested from the page cache
+#define VIDEO_READAHEAD (8 << 20)
+// recently decoded frames kept for stepping back without seeking, backwards they hold the
+// previous group of pictures, so the ring grows to the longest one measured as far as its
+// bytes allow; slots are allocated on first use
+#define VIDEO_RING_FRAMES 32
+#define VIDEO_RING_BYTES (256 << 20)
+// timeline previews, decoded from keyframes only by a second demuxer on a thread
+#define VIDEO_THUMBS 128
+#define VIDEO_THUMB_WIDTH 192
+// keyframes fed to the decoder per preview, decoders may hold a frame back
+#define VIDEO_THUMB_TRIES 4
+// frames are decoded at the stream size halved up to this many times, the smallest size
+// that is still at least as large as the video is shown
+#define VIDEO_SCALE_LEVELS 4
+// frame duration assumed for stepping back through streams without a known rate and
+// without two decoded frames to measure it from
+#define VIDEO_FALLBACK_FPS 30
+
+struct video_frame {
+	uint8_t *pixels;
+	size_t size;
+	double timecode;
+};
+
+struct video_thumbs {
+	pthread_t thread;
+	bool started;
+	atomic_bool stop;
+	int width;
+	int height;
+	uint8_t *pixels;
+	atomic_bool ready[VIDEO_THUMBS];
+	// the preview last uploaded for the main thread
+	Texture2D texture;
+	int shown;
+};
+
+// synced playback: a thread appends decoded frames to the ring while the main thread moves
+// ring_pos to the frame due at the shared clock, ring and decoder are shared under lock
+struct video_sync {
+	pthread_t thread;
+	bool started;
+	atomic_bool stop;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	// stream time at clock 0
+	double base;
+	// added to the timecodes of animations each time they start over
+	double loop_offset;
+};
 
 struct video {
 	const char *path;
 	int fd;
 
+	// whole file mapped read-only, NULL if the file is read through fd; fd stays open for
+	// checking the size of a mapped file
+	uint8_t *map;
+	size_t map_size;
+	int64_t advised_pos;
+	// decompressed member if the video is inside an archive
+	struct archive_data member;
+	// stdin or a pipe, read through its read-ahead buffer and never seeked
+	struct stream *stream;
+	bool seekable;
+
 	lp_ac_instance instance;
 	lp_ac_decoder decoder;
 
+	// frames are decoded straight into the ring, ring_pos is the shown one
+	struct video_frame *ring;
+	int ring_cap;
+	int ring_size;
+	int ring_start;
+	int ring_count;
+	int ring_pos;
+
+	// animated images start over at the end
+	bool loop;
+
 	int width;
 	int height;
+	// size frames are decoded at, width and height shifted right by scale
+	int scale;
+	int out_width;
+	int out_height;
+	// smallest scale while stepping back, groups of pictures too long for the ring at the
+	// shown size are decoded smaller, 0 once the video goes forward again
+	int backward_scale;
+	// longest distance between keyframes in frames, and the frames since the last one,
+	// -1 before the first
+	int gop;
+	int since_keyframe;
 	double fps;
 	double duration;
+
+	struct video_thumbs thumbs;
+	struct video_sync sync;
+	struct video *next_parked;
 };
 
-int video_get_fps(struct media *media) {
+// streams are consumed as they are decoded and cannot be opened again, so their video is
+// kept when the media is closed and taken up again when the stream is opened next
+static struct video *parked = NULL;
+
+double video_get_fps(struct media *media) {
 	struct video *video = media->userdata;
 	return video->fps;
 }
 
-static Texture2D video_draw_frame(struct video *video, int n) {
-	lp_ac_package pckt = NULL;
-	do {
-		pckt = ac_read_package(video->instance);
+bool video_is_animation(struct media *media) {
+	struct video *video = media->userdata;
+	return video->loop;
+}
+
+static struct video_frame *video_ring_at(struct video *video, int i) {
+	return &video->ring[(video->ring_start + i) % video->ring_size];
+}
+
+static size_t video_frame_bytes(struct video *video, int scale) {
+	return (size_t) (video->width >> scale) * (video->height >> scale) * 4;
+}
+
+// only called while the ring is empty, the slots past a smaller size are freed
+static void video_ring_init(struct video *video) {
+	int frames = video->gop + 1 > VIDEO_RING_FRAMES ? video->gop + 1 : VIDEO_RING_FRAMES;
+	video->ring_size = VIDEO_RING_BYTES / video->decoder->buffer_size;
+	// synced playback decodes into a second slot while the first one is shown
+	if (video->ring_size > frames) {
+		video->ring_size = frames;
+	} else if (video->ring_size < 2) {
+		video->ring_size = 2;
+	}
+
+	if (video->ring_size > video->ring_cap) {
+		video->ring = realloc(video->ring, video->ring_size * sizeof(struct video_frame));
+		memset(video->ring + video->ring_cap, 0, (video->ring_size - video->ring_cap) * sizeof(struct video_frame));
+		video->ring_cap = video->ring_size;
+	}
+	for (int i = video->ring_size; i < video->ring_cap; i++) {
+		free(video->ring[i].pixels);
+		video->ring[i] = (struct video_frame){0};
+	}
+}
+
+static void video_ring_clear(struct video *video) {
+	video->ring_start = 0;
+	video->ring_count = 0;
+	video->ring_pos = 0;
+}
+
+// reading a mapped file past its end raises SIGBUS, so once the file was truncated, e.g. by
+// a writer that overwrites it in place, its mapping is not read anymore; the video is opened
+// again when the change is reported
+static bool video_map_intact(struct video *video) {
+	struct stat st;
+	return video->map == NULL || (fstat(video->fd, &st) == 0 && st.st_size >= (off_t) video->map_size);
+}
+
+// decodes until the n-th next frame has been produced, n < 0 decodes the first frame available
+static bool video_decode(struct video *video, uint8_t *buffer, int n) {
+	ac_set_video_buffer(video->decoder, buffer);
+
+	bool looped = false;
+	int remaining = n < 0 ? 1 : n;
+	while (remaining > 0) {
+		if (!video_map_intact(video)) {
+			return false;
+		}
+		lp_ac_package pckt = ac_read_package(video->instance);
 		if (pckt == NULL) {
-			return (Texture2D){0};
+			if (!video->loop || looped) {
+				return false;
+			}
+			looped = true;
+			ac_seek(video->decoder, -1, 0);
+			continue;
 		} else if (pckt->stream_index != video->decoder->stream_index) {
 			ac_free_package(pckt);
 			continue;
 		}
 
+		if (pckt->keyframe) {
+			video->gop = video->since_keyframe > video->gop ? video->since_keyframe : video->gop;
+			video->since_keyframe = 0;
+		}
+		if (video->since_keyframe >= 0) {
+			video->since_keyframe++;
+		}
+
+		double start = perf_now();
 		int ret = ac_decode_package(pckt, video->decoder);
-		if (ret == 0 && n == 1) {
-			ac_free_package(pckt);
-			return (Texture2D){0};
-		} else if (n > 1 || (ret == 0 && n < 0)) {
-			ac_free_package(pckt);
-			n--;
-			continue;
+		ac_free_package(pckt);
+		if (ret != 0) {
+			perf_record_duration(PERF_DECODE, perf_now() - start - video->decoder->convert_time);
+			perf_record_duration(PERF_CONVERT, video->decoder->convert_time);
+			remaining--;
 		}
+	}
 
-		struct _ac_video_stream_info info = video->decoder->stream_info.additional_info.video_info;
+	return true;
+}
 
-		Image i = {
-			.data = video->decoder->pBuffer,
-			.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8,
-			.width = info.frame_width,
-			.height = info.frame_height,
-			.mipmaps = 1,
-		};
-		Texture2D t = LoadTextureFromImage(i);
-		ac_free_package(pckt);
-		return t;
-	} while (pckt != NULL);
+static bool video_decode_into(struct video *video, struct video_frame *frame, int n) {
+	size_t size = video->decoder->buffer_size;
+	if (frame->size < size) {
+		free(frame->pixels);
+		frame->pixels = malloc(size);
+		frame->size = size;
+	}
+	return video_decode(video, frame->pixels, n);
+}
+
+// decodes the n-th next frame into a new ring slot and makes it the shown frame
+static bool video_decode_next(struct video *video, int n) {
+	// the oldest frame is dropped up front, its slot is overwritten while decoding
+	if (video->ring_count == video->ring_size) {
+		video->ring_start = (video->ring_start + 1) % video->ring_size;
+		video->ring_count--;
+	}
+
+	struct video_frame *frame = video_ring_at(video, video->ring_count);
+	if (!video_decode_into(video, frame, n)) {
+		video->ring_pos = video->ring_count - 1;
+		return false;
+	}
+
+	frame->timecode = video->decoder->timecode;
+	video->ring_pos = video->ring_count++;
+	return true;
+}
+
+static double video_current_time(struct video *video) {
+	if (video->ring_count == 0) {
+		return video->decoder->timecode;
+	}
+	return video_ring_at(video, video->ring_pos)->timecode;
+}
+
+// the largest halving of the stream size that still covers width x height
+static int video_pick_scale(struct video *video, int width, int height) {
+	int scale = 0;
+	while (scale + 1 < VIDEO_SCALE_LEVELS && (video->width >> (scale + 1)) >= width &&
+	       (video->height >> (scale + 1)) >= height && (video->height >> (scale + 1)) > 0) {
+		scale++;
+	}
+	return scale;
+}
+
+static bool video_set_scale(struct video *video, int scale) {
+	int w = video->width >> scale;
+	int h = video->height >> scale;
+	if (!ac_set_video_output_size(video->decoder, w, h, false)) {
+		return false;
+	}
+	// the frames are allocated again at the new size, the ring may hold more or fewer of them
+	for (int i = 0; i < video->ring_cap; i++) {
+		free(video->ring[i].pixels);
+		video->ring[i] = (struct video_frame){0};
+	}
+	video->scale = scale;
+	video->out_width = w;
+	video->out_height = h;
+	video_ring_init(video);
+	return true;
+}
+
+// the frame duration, measured from the decoded frames when the stream has no known rate
+static double video_frame_time(struct video *video) {
+	if (video->fps > 0) {
+		return 1 / video->fps;
+	}
+	if (video->ring_count >= 2) {
+		double d = video_ring_at(video, 1)->timecode - video_ring_at(video, 0)->timecode;
+		if (d > 0) {
+			return d;
+		}
+	}
+	return 1.0 / VIDEO_FALLBACK_FPS;
+}
+
+// INDEX_EXACT indices are frames, or milliseconds when the frame rate is unknown
+static double video_index_time(struct video *video, int index) {
+	return video->fps > 0 ? index / video->fps : index / 1000.0;
+}
+
+// replaces the ring by the frames before its oldest one, decoded forward from the keyframe
+// before it, so that stepping or playing backwards decodes every group of pictures once;
+// the seek goes further back when it lands on the oldest frame again; a group too long for
+// the ring at the shown size is decoded at a smaller one until the video goes forward again
+static bool video_decode_previous(struct video *video) {
+	double frame = video_frame_time(video);
+	double end = video->ring_count > 0 ? video_ring_at(video, 0)->timecode : video_current_time(video);
+	if (end < frame / 2) {
+		return false;
+	}
+
+	int scale = video->scale;
+	while (scale + 1 < VIDEO_SCALE_LEVELS && (video->height >> (scale + 1)) > 0 &&
+	       (size_t) (video->gop + 1) * video_frame_bytes(video, scale) > VIDEO_RING_BYTES) {
+		scale++;
+	}
+	if (scale != video->scale && video_set_scale(video, scale)) {
+		video->backward_scale = scale;
+	}
+	video_ring_clear(video);
+	video_ring_init(video);
 
-	return (Texture2D){0};
+	double back = frame / 2;
+	for (int attempt = 0; attempt < 4; attempt++, back *= 8) {
+		ac_seek(video->decoder, -1, 1000 * (end - back));
+		video_ring_clear(video);
+		while (video_decode_next(video, 1)) {
+			if (video_ring_at(video, video->ring_pos)->timecode >= end - frame / 2) {
+				video->ring_count--;
+				break;
+			}
+		}
+		if (video->ring_count > 0 || end - back <= 0) {
+			break;
+		}
+	}
+
+	video->ring_pos = video->ring_count - 1;
+	return video->ring_count > 0;
+}
+
+// seeks to the keyframe before time and decodes forward to the frame shown at time, the
+// frames before it stay in the ring for stepping back
+static bool video_decode_at(struct video *video, double time) {
+	double half = video->fps > 0 ? 0.5 / video->fps : 0;
+	ac_seek(video->decoder, -1, 1000 * time);
+	video_ring_clear(video);
+	while (video_decode_next(video, 1)) {
+		if (video_ring_at(video, video->ring_pos)->timecode >= time - half) {
+			return true;
+		}
+	}
+	return video->ring_count > 0;
+}
+
+// uploads the shown frame, reusing the texture while the frame size stays the same
+static void video_show(struct media *media) {
+	struct video *video = media->userdata;
+	if (video->ring_count == 0) {
+		perf_unload_texture(media->texture);
+		media->texture = (Texture2D){0};
+		return;
+	}
+
+	struct video_frame *frame = video_ring_at(video, video->ring_pos);
+	perf_set_decode_ahead(video->ring_count - 1 - video->ring_pos);
+	if (media->texture.id > 0 && media->texture.width == video->out_width && media->texture.height == video->out_height) {
+		perf_update_texture(media->texture, frame->pixels);
+		return;
+	}
+
+	Image i = {
+		.data = frame->pixels,
+		.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+		.width = video->out_width,
+		.height = video->out_height,
+		.mipmaps = 1,
+	};
+	perf_unload_texture(media->texture);
+	media->texture = perf_load_texture(i);
 }
 
 // frame:   ffmpeg -i DJI_0703.MP4 -vf "select=eq(n\,34)" -vframes 1 -c:v bmp -f rawvideo - | pv > /dev/null
@@ -72,6 +393,12 @@ static int video_read_cb(void *sender, uint8_t *buf, int size) {
 	return read(video->fd, buf, size);
 }
 
+// the sender is the video, the media of a parked video is gone
+static int video_stream_read_cb(void *sender, uint8_t *buf, int size) {
+	struct video *video = sender;
+	return stream_read(video->stream, buf, size);
+}
+
 static int64_t video_seek_cb(void *sender, int64_t pos, int whence) {
 	struct media *media = sender;
 	struct video *video = media->userdata;
@@ -96,10 +423,186 @@ static int video_close_cb(void *sender) {
 	return close(video->fd);
 }
 
-static const char *video_text(struct media *self) {
+static void video_advise(struct video *video) {
+	if (video->map == NULL) {
+		return;
+	}
+
+	int64_t pos = ac_get_io_position(video->instance);
+	if (pos < 0 || (pos >= video->advised_pos && pos < video->advised_pos + VIDEO_READAHEAD / 2)) {
+		return;
+	}
+
+	int64_t page = sysconf(_SC_PAGESIZE);
+	int64_t start = pos & ~(page - 1);
+	int64_t len = VIDEO_READAHEAD;
+	if (start + len > (int64_t) video->map_size) {
+		len = video->map_size - start;
+	}
+
+	madvise(video->map + start, len, MADV_WILLNEED);
+	video->advised_pos = pos;
+}
+
+static bool video_map(struct video *video) {
+	int fd = open(video->path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	video->fd = fd;
+	video->map = map;
+	video->map_size = st.st_size;
+	video->advised_pos = -VIDEO_READAHEAD;
+	return true;
+}
+
+static void video_unmap(struct video *video) {
+	if (video->map != NULL) {
+		munmap(video->map, video->map_size);
+		close(video->fd);
+		video->map = NULL;
+	}
+}
+
+// the oldest frame is only dropped once it is not shown anymore, so the shown frame is
+// never written to while it is uploaded
+static void *video_sync_thread(void *arg) {
+	struct video *video = arg;
+	struct video_sync *sync = &video->sync;
+	double frame_time = video->fps > 0 ? 1 / video->fps : 0;
+
+	pthread_mutex_lock(&sync->lock);
+	while (!atomic_load(&sync->stop)) {
+		if (video->ring_count == video->ring_size && video->ring_pos == 0) {
+			pthread_cond_wait(&sync->cond, &sync->lock);
+			continue;
+		}
+		if (video->ring_count == video->ring_size) {
+			video->ring_start = (video->ring_start + 1) % video->ring_size;
+			video->ring_count--;
+			video->ring_pos--;
+		}
+
+		struct video_frame *frame = video_ring_at(video, video->ring_count);
+		double last = video->ring_count > 0 ? video_ring_at(video, video->ring_count - 1)->timecode : -1;
+		pthread_mutex_unlock(&sync->lock);
+		bool ok = video_decode_into(video, frame, 1);
+		video_advise(video);
+		pthread_mutex_lock(&sync->lock);
+		if (!ok) {
+			break;
+		}
+
+		frame->timecode = video->decoder->timecode + sync->loop_offset;
+		if (frame->timecode < last) {
+			sync->loop_offset += last + frame_time - frame->timecode;
+			frame->timecode = last + frame_time;
+		}
+		video->ring_count++;
+	}
+	pthread_mutex_unlock(&sync->lock);
+	return NULL;
+}
+
+static void video_sync_start(struct video *video, double base) {
+	struct video_sync *sync = &video->sync;
+	atomic_store(&sync->stop, false);
+	sync->base = base;
+	sync->loop_offset = 0;
+	pthread_mutex_init(&sync->lock, NULL);
+	pthread_cond_init(&sync->cond, NULL);
+	sync->started = pthread_create(&sync->thread, NULL, video_sync_thread, video) == 0;
+	if (!sync->started) {
+		pthread_mutex_destroy(&sync->lock);
+		pthread_cond_destroy(&sync->cond);
+	}
+}
+
+static void video_sync_stop(struct video *video) {
+	struct video_sync *sync = &video->sync;
+	if (!sync->started) {
+		return;
+	}
+
+	pthread_mutex_lock(&sync->lock);
+	atomic_store(&sync->stop, true);
+	pthread_cond_signal(&sync->cond);
+	pthread_mutex_unlock(&sync->lock);
+	pthread_join(sync->thread, NULL);
+	pthread_mutex_destroy(&sync->lock);
+	pthread_cond_destroy(&sync->cond);
+	sync->started = false;
+}
+
+// the ring is only read under lock while the thread may append to it
+static void video_lock(struct video *video) {
+	if (video->sync.started) {
+		pthread_mutex_lock(&video->sync.lock);
+	}
+}
+
+static void video_unlock(struct video *video) {
+	if (video->sync.started) {
+		pthread_mutex_unlock(&video->sync.lock);
+	}
+}
+
+// shows the last frame that is due at clock seconds after the playback started,
+// a negative clock stops decoding ahead
+static void video_sync(struct media *self, double clock) {
 	struct video *video = self->userdata;
-	if (self->texture.id > 0) {
-		double t = video->decoder->timecode;
+	struct video_sync *sync = &video->sync;
+	if (clock < 0) {
+		video_sync_stop(video);
+		return;
+	}
+	if (!sync->started) {
+		video->backward_scale = 0;
+		video_sync_start(video, video_current_time(video) - clock);
+		if (!sync->started) {
+			return;
+		}
+	}
+
+	pthread_mutex_lock(&sync->lock);
+	int pos = video->ring_pos;
+	while (pos + 1 < video->ring_count && video_ring_at(video, pos + 1)->timecode <= sync->base + clock) {
+		pos++;
+	}
+	if (pos - video->ring_pos > 1) {
+		perf_count(PERF_DROPPED_FRAMES, pos - video->ring_pos - 1);
+	}
+	if (pos != video->ring_pos || self->texture.id == 0) {
+		video->ring_pos = pos;
+		video_show(self);
+		pthread_cond_signal(&sync->cond);
+	}
+	pthread_mutex_unlock(&sync->lock);
+}
+
+static const char *video_text_locked(struct media *self) {
+	struct video *video = self->userdata;
+	if (self->texture.id > 0 && video->scale > 0) {
+		double t = video_current_time(video);
+		double d = video->duration;
+		return TextFormat("time %.2lf/%.2lf @ %g fps (%dx%d, decoded at %dx%d)", t, d, video->fps,
+		                  video->width, video->height, video->out_width, video->out_height);
+	} else if (self->texture.id > 0) {
+		double t = video_current_time(video);
 		double d = video->duration;
 		return TextFormat("time %.2lf/%.2lf @ %g fps (%dx%d)", t, d, video->fps, video->width, video->height);
 	} else {
@@ -107,43 +610,316 @@ static const char *video_text(struct media *self) {
 	}
 }
 
+static const char *video_text(struct media *self) {
+	struct video *video = self->userdata;
+	video_lock(video);
+	const char *text = video_text_locked(self);
+	video_unlock(video);
+	return text;
+}
+
+// the decoded frames have the old size, so the shown one is decoded again at the new size;
+// streams cannot go back to it and keep the size they were opened with
+static void video_set_view(struct media *self, int width, int height) {
+	struct video *video = self->userdata;
+	int scale = video_pick_scale(video, width, height);
+	scale = scale < video->backward_scale ? video->backward_scale : scale;
+	if (scale == video->scale || !video->seekable || !video_map_intact(video)) {
+		return;
+	}
+	// synced playback starts again from the new frame with the next clock
+	video_sync_stop(video);
+
+	double time = video_current_time(video);
+	if (!video_set_scale(video, scale)) {
+		return;
+	}
+	if (!video_decode_at(video, time)) {
+		video_ring_clear(video);
+	}
+	video_show(self);
+}
+
 static void video_set_index(struct media *self, int index_mode, int amount) {
 	struct video *video = self->userdata;
-	int current_time = 1000 * video->decoder->timecode;
-	int nframes = amount;
+	video_sync_stop(video);
+	// seeking reads the file as well, a truncated one keeps showing its frame until reopened
+	if (!video_map_intact(video)) {
+		return;
+	}
+	if (index_mode != INDEX_RELATIVE || amount > 0) {
+		video->backward_scale = 0;
+	}
+	int current_time = 1000 * video_current_time(video);
+	int target = video->ring_pos + amount;
+	bool ok;
 
-	if (index_mode == INDEX_RELATIVE) {
-		int delta = 1000 / video->fps * amount;
-		if (delta < 0) {
+	if (index_mode == INDEX_RELATIVE && target >= 0 && target < video->ring_count) {
+		video->ring_pos = target;
+		ok = true;
+	} else if (index_mode == INDEX_RELATIVE && amount > 0) {
+		ok = video_decode_next(video, target - (video->ring_count - 1));
+	} else if (!video->seekable) {
+		// streams only go back as far as the ring reaches and cannot jump
+		if (index_mode == INDEX_RELATIVE) {
+			video->ring_pos = 0;
+		}
+		ok = video->ring_count > 0;
+	} else if (index_mode == INDEX_RELATIVE && !video->loop) {
+		// the first frame is kept when there is nothing before it
+		while (target < 0 && video_decode_previous(video)) {
+			target += video->ring_count;
+		}
+		ok = video->ring_count > 0;
+		video->ring_pos = target < 0 ? 0 : target;
+	} else {
+		if (index_mode == INDEX_RELATIVE) {
+			int delta = 1000 * video_frame_time(video) * amount;
 			ac_seek(video->decoder, -1, current_time + delta);
-			nframes = 1;
+		} else {
+			int time = 1000 * (index_mode == INDEX_EXACT ? video_index_time(video, amount) : video->duration * amount / 10);
+			int dir = current_time < time ? 0 : -1;
+			ac_seek(video->decoder, dir, time);
 		}
+		video_ring_clear(video);
+		ok = video_decode_next(video, 1);
+	}
+
+	if (!ok) {
+		video_ring_clear(video);
+	}
+	video_show(self);
+	video_advise(video);
+}
+
+// decodes the keyframe at or before every preview position, coarse positions first so that
+// the whole timeline has previews early
+static void *video_thumbs_thread(void *arg) {
+	struct video *video = arg;
+	struct video_thumbs *thumbs = &video->thumbs;
+	const uint8_t *data = video->member.data ? video->member.data : video->map;
+	size_t size = video->member.data ? video->member.size : video->map_size;
+
+	lp_ac_instance instance = ac_init();
+	instance->output_format = AC_OUTPUT_RGBA32;
+	lp_ac_decoder decoder = NULL;
+	if (ac_open_memory(instance, data, size) >= 0 && instance->opened) {
+		decoder = ac_create_decoder(instance, video->decoder->stream_index);
+	}
+	if (decoder != NULL) {
+		for (int i = 0; i < instance->stream_count; i++) {
+			ac_set_stream_discard(instance, i, i != decoder->stream_index);
+		}
+		ac_set_skip_nonkey(decoder, true);
+		if (!ac_set_video_output_size(decoder, thumbs->width, thumbs->height, true)) {
+			ac_free_decoder(decoder);
+			decoder = NULL;
+		}
+	}
+
+	bool tried[VIDEO_THUMBS] = {0};
+	for (int stride = VIDEO_THUMBS / 2; stride >= 1 && decoder != NULL; stride /= 2) {
+		for (int i = 0; i < VIDEO_THUMBS && !atomic_load(&thumbs->stop) && video_map_intact(video); i += stride) {
+			if (tried[i]) {
+				continue;
+			}
+			tried[i] = true;
+
+			size_t thumb_size = (size_t) thumbs->width * thumbs->height * 4;
+			ac_set_video_buffer(decoder, thumbs->pixels + i * thumb_size);
+			ac_seek(decoder, -1, 1000 * video->duration * i / VIDEO_THUMBS);
+			for (int tries = 0; tries < VIDEO_THUMB_TRIES && video_map_intact(video);) {
+				lp_ac_package pckt = ac_read_package(instance);
+				if (pckt == NULL) {
+					break;
+				} else if (pckt->stream_index != decoder->stream_index || !pckt->keyframe) {
+					ac_free_package(pckt);
+					continue;
+				}
+
+				int ret = ac_decode_package(pckt, decoder);
+				ac_free_package(pckt);
+				tries++;
+				if (ret != 0) {
+					atomic_store(&thumbs->ready[i], true);
+					break;
+				}
+			}
+		}
+		glfwPostEmptyEvent();
+	}
+
+	ac_free_decoder(decoder);
+	ac_free(instance);
+	return NULL;
+}
+
+// needs the file in memory, videos read through a file descriptor get no previews
+static void video_thumbs_start(struct video *video) {
+	struct video_thumbs *thumbs = &video->thumbs;
+	if ((video->map == NULL && video->member.data == NULL) || video->width <= 0 || video->height <= 0) {
+		return;
+	}
+
+	thumbs->width = VIDEO_THUMB_WIDTH;
+	thumbs->height = (VIDEO_THUMB_WIDTH * video->height / video->width + 1) & ~1;
+	thumbs->pixels = malloc((size_t) VIDEO_THUMBS * thumbs->width * thumbs->height * 4);
+	thumbs->shown = -1;
+	thumbs->started = pthread_create(&thumbs->thread, NULL, video_thumbs_thread, video) == 0;
+}
+
+static void video_thumbs_stop(struct video *video) {
+	struct video_thumbs *thumbs = &video->thumbs;
+	if (thumbs->started) {
+		atomic_store(&thumbs->stop, true);
+		pthread_join(thumbs->thread, NULL);
+	}
+	perf_unload_texture(thumbs->texture);
+	free(thumbs->pixels);
+}
+
+static float video_progress(struct media *self, int *count) {
+	struct video *video = self->userdata;
+	*count = video->fps > 0 ? video->duration * video->fps : video->duration * 1000;
+	if (video->duration <= 0) {
+		return 0;
+	}
+	video_lock(video);
+	float progress = video_current_time(video) / video->duration;
+	video_unlock(video);
+	return progress;
+}
+
+// the closest preview that is decoded already
+static Texture2D video_preview(struct media *self, float position) {
+	struct video *video = self->userdata;
+	struct video_thumbs *thumbs = &video->thumbs;
+	if (!thumbs->started) {
+		return (Texture2D){0};
+	}
+
+	int want = position * (VIDEO_THUMBS - 1) + 0.5;
+	int best = -1;
+	for (int d = 0; d < VIDEO_THUMBS && best < 0; d++) {
+		if (want - d >= 0 && atomic_load(&thumbs->ready[want - d])) {
+			best = want - d;
+		} else if (want + d < VIDEO_THUMBS && atomic_load(&thumbs->ready[want + d])) {
+			best = want + d;
+		}
+	}
+	if (best < 0 || best == thumbs->shown) {
+		return best < 0 ? (Texture2D){0} : thumbs->texture;
+	}
+
+	uint8_t *pixels = thumbs->pixels + (size_t) best * thumbs->width * thumbs->height * 4;
+	if (thumbs->texture.id == 0) {
+		Image i = {
+			.data = pixels,
+			.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+			.width = thumbs->width,
+			.height = thumbs->height,
+			.mipmaps = 1,
+		};
+		thumbs->texture = perf_load_texture(i);
 	} else {
-		int time = 1000 * video->duration * amount / 10;
-		int dir = current_time < time ? 0 : -1;
-		ac_seek(video->decoder, dir, time);
-		nframes = 1;
+		perf_update_texture(thumbs->texture, pixels);
 	}
+	thumbs->shown = best;
+	return thumbs->texture;
+}
 
-	UnloadTexture(self->texture);
-	self->texture = video_draw_frame(video, nframes);
+// releases what video_load opened, needs no gl context
+static void video_free(struct video *video) {
+	ac_free_decoder(video->decoder);
+	ac_free(video->instance);
+	video_unmap(video);
+	archive_release(&video->member);
+	for (int i = 0; i < video->ring_cap; i++) {
+		free(video->ring[i].pixels);
+	}
+	free(video->ring);
+	free(video);
 }
 
-static bool video_open(struct media *media, const char *mediapath) {
+// only the shown frame is kept, the rest of the ring is freed
+static void video_park(struct video *video) {
+	int shown = (video->ring_start + video->ring_pos) % video->ring_size;
+	for (int i = 0; i < video->ring_size; i++) {
+		if (i != shown || video->ring_count == 0) {
+			free(video->ring[i].pixels);
+			video->ring[i] = (struct video_frame){0};
+		}
+	}
+	video->ring_start = shown;
+	video->ring_count = video->ring_count > 0 ? 1 : 0;
+	video->ring_pos = 0;
+	video->next_parked = parked;
+	parked = video;
+}
+
+static struct video *video_unpark(const char *mediapath) {
+	struct stream *stream = stream_get(mediapath);
+	for (struct video **v = &parked; *v != NULL; v = &(*v)->next_parked) {
+		if ((*v)->stream == stream) {
+			struct video *video = *v;
+			*v = video->next_parked;
+			video->path = mediapath;
+			return video;
+		}
+	}
+	return NULL;
+}
+
+static void video_close(struct media *self) {
+	struct video *video = self->userdata;
+	video_sync_stop(video);
+	video_thumbs_stop(video);
+	perf_unload_texture(self->texture);
+	if (video->stream != NULL && !video->seekable) {
+		video_park(video);
+	} else {
+		video_free(video);
+	}
+	*self = (struct media){0};
+}
+
+// opens the container and its first video stream into media->userdata, nothing is decoded yet
+static bool video_load(struct media *media, const char *mediapath) {
 	struct video *video = calloc(1, sizeof(struct video));
 	video->path = mediapath;
-
-	*media = (struct media){
-		.text = video_text,
-		.set_index = video_set_index,
-		.userdata = video,
-		.texture = {0},
-	};
+	video->since_keyframe = -1;
+	*media = (struct media){.userdata = video};
 
 	video->instance = ac_init();
-	video->instance->output_format = AC_OUTPUT_RGB24;
+	video->instance->output_format = AC_OUTPUT_RGBA32;
+
+	int res;
+	const unsigned char *data;
+	size_t size;
+	video->seekable = true;
+	if (stream_is_stream(mediapath)) {
+		// an animated image read whole by the image module is decoded from memory
+		video->stream = stream_get(mediapath);
+		if (video->stream == NULL) {
+			res = -1;
+		} else if (stream_complete(video->stream, &data, &size)) {
+			res = ac_open_memory(video->instance, data, size);
+		} else {
+			video->seekable = false;
+			res = ac_open(video->instance, video, NULL, video_stream_read_cb, NULL, NULL, NULL);
+		}
+	} else if (archive_is_member(mediapath)) {
+		res = archive_read(mediapath, &video->member) ? ac_open_memory(video->instance, video->member.data, video->member.size) : -1;
+	} else if (video_map(video)) {
+		res = ac_open_memory(video->instance, video->map, video->map_size);
+	} else {
+		res = ac_open(video->instance, media, video_open_cb, video_read_cb, video_seek_cb, video_close_cb, NULL);
+	}
 
-	if (ac_open(video->instance, media, video_open_cb, video_read_cb, video_seek_cb, video_close_cb, NULL) < 0) {
+	if (res < 0) {
+		ac_free(video->instance);
+		video_unmap(video);
+		archive_release(&video->member);
 		free(video);
 		*media = (struct media){0};
 		return false;
@@ -152,16 +928,19 @@ static bool video_open(struct media *media, const char *mediapath) {
 	for (int i = 0; i < video->instance->stream_count; i++) {
 		ac_stream_info info;
 		ac_get_stream_info(video->instance, i, &info);
-		if (info.stream_type != AC_STREAM_TYPE_VIDEO) {
-			continue;
+		if (info.stream_type == AC_STREAM_TYPE_VIDEO && video->decoder == NULL) {
+			video->decoder = ac_create_decoder(video->instance, i);
 		}
 
-		if (video->decoder == NULL) {
-			video->decoder = ac_create_decoder(video->instance, i);
+		if (video->decoder == NULL || video->decoder->stream_index != i) {
+			ac_set_stream_discard(video->instance, i, true);
 		}
 	}
 
 	if (!video->instance->opened || video->decoder == NULL) {
+		ac_free(video->instance);
+		video_unmap(video);
+		archive_release(&video->member);
 		free(video);
 		*media = (struct media){0};
 		return false;
@@ -171,12 +950,91 @@ static bool video_open(struct media *media, const char *mediapath) {
 	video->width = video->decoder->stream_info.additional_info.video_info.frame_width;
 	video->height = video->decoder->stream_info.additional_info.video_info.frame_height;
 	video->duration = video->instance->info.duration / 1000.0;
+	return true;
+}
+
+static bool video_open(struct media *media, const char *mediapath) {
+	struct video *resumed = stream_is_stream(mediapath) ? video_unpark(mediapath) : NULL;
+	if (resumed != NULL) {
+		*media = (struct media){.userdata = resumed};
+	} else if (!video_load(media, mediapath)) {
+		return false;
+	}
+
+	struct video *video = media->userdata;
+	media->text = video_text;
+	media->set_index = video_set_index;
+	media->close = video_close;
+	media->progress = video_progress;
+	media->preview = video_preview;
+	media->set_view = video_set_view;
+	media->sync = video_sync;
+	if (resumed != NULL) {
+		// the stream continues after the frame that was shown when it was closed
+		video_show(media);
+		return true;
+	}
 
-	media->texture = video_draw_frame(video, -1);
+	// streams in memory are animated images the image module read whole
+	video->loop = IsFileExtension(mediapath, ".gif;.png;.apng;.webp") || (video->stream != NULL && video->seekable);
+	video->out_width = video->width;
+	video->out_height = video->height;
+	video_ring_init(video);
+	// starts at the size the video is fitted to the window with, zooming changes it later
+	if (video->width > 0 && video->height > 0) {
+		float fit = fminf(GetScreenWidth() / (float) video->width, GetScreenHeight() / (float) video->height);
+		int scale = video_pick_scale(video, video->width * fit, video->height * fit);
+		if (scale > 0) {
+			video_set_scale(video, scale);
+		}
+	}
+	video_decode_next(video, -1);
+	video_show(media);
+	video_advise(video);
+	if (!video->loop) {
+		video_thumbs_start(video);
+	}
 
 	return true;
 }
 
+// decoded forward from the keyframe before the frame, at the full size
+bool video_export_frame(const char *path, double seconds, int frame_number, Image *image) {
+	struct media media;
+	if (!video_load(&media, path)) {
+		return false;
+	}
+
+	struct video *video = media.userdata;
+	double frame = video->fps > 0 ? 1 / video->fps : 0;
+	if (frame_number >= 0) {
+		seconds = frame_number * frame;
+	}
+	uint8_t *pixels = malloc(video->decoder->buffer_size);
+	bool ok = false;
+	ac_seek(video->decoder, -1, 1000 * seconds);
+	while (video_decode(video, pixels, 1)) {
+		ok = true;
+		if (video->decoder->timecode >= seconds - frame / 2) {
+			break;
+		}
+	}
+
+	*image = (Image){
+		.data = pixels,
+		.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+		.width = video->width,
+		.height = video->height,
+		.mipmaps = 1,
+	};
+	video_free(video);
+	if (!ok) {
+		free(pixels);
+		*image = (Image){0};
+	}
+	return ok;
+}
+
 struct module video_init(void) {
 	return (struct module) {
 		.open = video_open,
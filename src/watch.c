@@ -0,0 +1,218 @@
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "archive.h"
+#include "module.h"
+#include "perf.h"
+#include "stream.h"
+#include "watch.h"
+
+// seconds a file must be left alone after a change before it is reported
+#define WATCH_QUIET 0.2
+// writes and renames onto the path, deletions are left alone so the last version stays shown
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO)
+
+struct watched {
+	char *path;
+	// last component, the events of the directory are matched against it
+	const char *name;
+	int wd;
+	// time the last change of the path is reported at, 0 while it is unchanged
+	double due;
+};
+
+static int fd = -1;
+static pthread_t thread;
+
+// guards everything below
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct watched *watched = NULL;
+static int n_watched = 0;
+static int watched_cap = 0;
+static char **changed = NULL;
+static int n_changed = 0;
+
+// called with lock held, the name of a directory entry changed
+static void note_change(int wd, const char *name) {
+	for (int i = 0; i < n_watched; i++) {
+		if (watched[i].wd == wd && strcmp(watched[i].name, name) == 0) {
+			watched[i].due = perf_now() + WATCH_QUIET;
+		}
+	}
+}
+
+// called with lock held, moves the paths that were quiet long enough to the changed ones and
+// returns the milliseconds until the next one is due, -1 if none is pending
+static int report_quiet(double now) {
+	double next = 0;
+	for (int i = 0; i < n_watched; i++) {
+		if (watched[i].due == 0) {
+			continue;
+		}
+		if (watched[i].due <= now) {
+			changed = realloc(changed, (n_changed + 1) * sizeof(char *));
+			changed[n_changed++] = strdup(watched[i].path);
+			watched[i].due = 0;
+		} else if (next == 0 || watched[i].due < next) {
+			next = watched[i].due;
+		}
+	}
+	return next == 0 ? -1 : (int) ((next - now) * 1000) + 1;
+}
+
+static void *watch_thread(void *arg) {
+	(void) arg;
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+	int timeout = -1;
+	for (;;) {
+		ssize_t len = poll(&pfd, 1, timeout) > 0 ? read(fd, buf, sizeof(buf)) : 0;
+
+		pthread_mutex_lock(&lock);
+		for (char *p = buf; len > 0 && p < buf + len;) {
+			struct inotify_event *event = (struct inotify_event *) p;
+			if (event->len > 0) {
+				note_change(event->wd, event->name);
+			}
+			p += sizeof(struct inotify_event) + event->len;
+		}
+		int reported = n_changed;
+		timeout = report_quiet(perf_now());
+		reported = n_changed - reported;
+		pthread_mutex_unlock(&lock);
+
+		if (reported > 0) {
+			glfwPostEmptyEvent();
+		}
+	}
+	return NULL;
+}
+
+static bool watch_start(void) {
+	if (fd >= 0) {
+		return true;
+	}
+
+	fd = inotify_init1(IN_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	if (pthread_create(&thread, NULL, watch_thread, NULL) != 0) {
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	return true;
+}
+
+// the file a path changes with, members change with their archive
+static char *watched_file(const char *path) {
+	const char *sep = archive_member_separator(path);
+	return sep != NULL ? strndup(path, sep - path) : strdup(path);
+}
+
+// called with lock held
+static void watch_file(char *file) {
+	char *slash = strrchr(file, '/');
+	char *dir = slash == NULL ? strdup(".") : slash == file ? strdup("/") : strndup(file, slash - file);
+	// the directory is only watched once, inotify returns its watch again for its other files
+	int wd = inotify_add_watch(fd, dir, WATCH_EVENTS);
+	free(dir);
+	if (wd < 0) {
+		free(file);
+		return;
+	}
+
+	if (n_watched == watched_cap) {
+		watched_cap = watched_cap == 0 ? 64 : watched_cap * 2;
+		watched = realloc(watched, watched_cap * sizeof(struct watched));
+	}
+	watched[n_watched++] = (struct watched){
+		.path = file,
+		.name = slash == NULL ? file : slash + 1,
+		.wd = wd,
+	};
+}
+
+// called with lock held, the directory stays watched while another path in it is
+static void unwatch(int i) {
+	int wd = watched[i].wd;
+	free(watched[i].path);
+	watched[i] = watched[--n_watched];
+	for (int j = 0; j < n_watched; j++) {
+		if (watched[j].wd == wd) {
+			return;
+		}
+	}
+	inotify_rm_watch(fd, wd);
+}
+
+void watch_set(const char **paths, int n) {
+	if (!watch_start()) {
+		return;
+	}
+
+	char **files = malloc(n * sizeof(char *));
+	int n_files = 0;
+	for (int i = 0; i < n; i++) {
+		if (!stream_is_stream(paths[i])) {
+			files[n_files++] = watched_file(paths[i]);
+		}
+	}
+
+	// the sets are small, a few files around the current one
+	pthread_mutex_lock(&lock);
+	for (int i = n_watched - 1; i >= 0; i--) {
+		bool kept = false;
+		for (int j = 0; j < n_files && !kept; j++) {
+			kept = strcmp(watched[i].path, files[j]) == 0;
+		}
+		if (!kept) {
+			unwatch(i);
+		}
+	}
+	for (int j = 0; j < n_files; j++) {
+		bool known = false;
+		for (int i = 0; i < n_watched && !known; i++) {
+			known = strcmp(watched[i].path, files[j]) == 0;
+		}
+		if (known) {
+			free(files[j]);
+		} else {
+			watch_file(files[j]);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	free(files);
+}
+
+void watch_clear(void) {
+	pthread_mutex_lock(&lock);
+	for (int i = 0; i < n_watched; i++) {
+		// directories shared by several paths are removed on the first call, the others fail
+		inotify_rm_watch(fd, watched[i].wd);
+		free(watched[i].path);
+	}
+	n_watched = 0;
+	for (int i = 0; i < n_changed; i++) {
+		free(changed[i]);
+	}
+	free(changed);
+	changed = NULL;
+	n_changed = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+char **watch_poll(int *n) {
+	pthread_mutex_lock(&lock);
+	char **paths = changed;
+	*n = n_changed;
+	changed = NULL;
+	n_changed = 0;
+	pthread_mutex_unlock(&lock);
+	return paths;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// The shown file and the ones cached around it are watched with inotify, e.g. renders that
+// are overwritten while they are shown. Their directories are watched rather than the files themselves, since
+// many writers replace a file by renaming a new one over it. A change is reported once the
+// file was quiet for a while, so that files written in chunks are only read when complete.
+
+// watches exactly these paths from now on, members watch their archive and streams are
+// not watched
+void watch_set(const char **paths, int n);
+// stops watching every path, changes not polled yet are dropped
+void watch_clear(void);
+// watched paths that changed since the last call or NULL, the array and strings are owned
+// by the caller; members are reported by the path of their archive
+char **watch_poll(int *n);